@@ -0,0 +1,13 @@
+#version 330 core
+
+layout(location = 0) in vec3 v_position;
+layout(location = 3) in mat4 v_model; // per instance (Mesh::setInstances), locations 3 to 6
+
+layout(std140) uniform Frame { // FrameUniforms, updated once per frame
+  mat4 projection;
+  mat4 view;
+};
+
+void main() {
+  gl_Position = projection * view * v_model * vec4(v_position, 1.0);
+}
\ No newline at end of file
@@ -4,7 +4,11 @@ layout(location = 0) in vec3 v_position;
 layout(location = 1) in vec3 v_normal;
 layout(location = 2) in vec2 v_uv;
 
-uniform mat4 projection, model_view, normal_mat;
+layout(std140) uniform Frame { // FrameUniforms, updated once per frame
+  mat4 projection;
+  mat4 view;
+};
+uniform mat4 model_view, normal_mat;
 
 out vec3 f_position;
 out vec3 f_position_world_space;
@@ -2,7 +2,10 @@
 
 layout(location = 0) in vec3 v_position;
 
-uniform mat4 projection, view;
+layout(std140) uniform Frame { // FrameUniforms, updated once per frame
+  mat4 projection;
+  mat4 view;
+};
 
 void main() {
   gl_Position = projection * view * vec4(v_position, 1.0);
@@ -0,0 +1,47 @@
+#include "AllocationCounter.hpp"
+
+#ifdef HEAP_ALLOCATIONS_COUNTED
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> g_heap_allocations(0);
+static thread_local size_t t_heap_allocations = 0;
+
+// Replacing the global operator new / delete is enough: the array and nothrow versions call them
+void *operator new(std::size_t _size) {
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    t_heap_allocations++;
+    if (void *pointer = std::malloc(_size ? _size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *_pointer) noexcept {
+    std::free(_pointer);
+}
+
+void operator delete(void *_pointer, std::size_t) noexcept {
+    std::free(_pointer);
+}
+
+size_t heapAllocationCount() {
+    return g_heap_allocations;
+}
+
+size_t threadHeapAllocationCount() {
+    return t_heap_allocations;
+}
+
+#else
+
+size_t heapAllocationCount() {
+    return 0;
+}
+
+size_t threadHeapAllocationCount() {
+    return 0;
+}
+
+#endif
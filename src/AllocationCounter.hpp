@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+// Counted in DEBUG builds and in the builds defining COUNT_HEAP_ALLOCATIONS (the headless runner by default)
+#if defined(DEBUG) || defined(COUNT_HEAP_ALLOCATIONS)
+#define HEAP_ALLOCATIONS_COUNTED 1
+#endif
+
+// Number of heap allocations (operator new) made by the whole program so far, always 0 when not counted.
+size_t heapAllocationCount();
+// Same, made by the calling thread only
+size_t threadHeapAllocationCount();
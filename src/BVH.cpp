@@ -0,0 +1,299 @@
+#include "BVH.hpp"
+#include <algorithm>
+#include <cfloat>
+
+static const uint BIN_COUNT = 16;
+static const uint MAX_LEAF_SIZE = 4;       // a node is always split above
+static const uint MAX_DEPTH = 60;          // the traversal stack holds 64 nodes
+static const uint BVH_GRAIN = 16384;      // triangles per parallel task when binning
+static const uint BVH_SUBTREE_SIZE = 1024; // nodes up to this size are the roots of subtrees built in parallel
+
+struct Bin {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    uint count = 0;
+
+    inline void add(const glm::vec3 &_min, const glm::vec3 &_max, uint _count) {
+        min = glm::min(min, _min);
+        max = glm::max(max, _max);
+        count += _count;
+    }
+};
+
+static inline float surfaceArea(const glm::vec3 &_min, const glm::vec3 &_max) {
+    glm::vec3 d = glm::max(_max - _min, glm::vec3(0.f));
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+void StaticBVH::build(const Mesh &_mesh, const glm::mat4 &_model, ThreadPool &_thread_pool) {
+    const std::vector<glm::vec3> &positions = _mesh.vertexPositions();
+    const std::vector<glm::uvec3> &triangles = _mesh.triangleIndices();
+
+    // world positions, bounds and centroids of the non degenerated triangles
+    std::vector<glm::vec3> world_positions(positions.size());
+    _thread_pool.parallelFor(0, positions.size(), BVH_GRAIN, [&](uint _i) {
+        world_positions[_i] = glm::vec3(_model * glm::vec4(positions[_i], 1.f));
+    });
+    std::vector<uint> kept;
+    kept.reserve(triangles.size());
+    for (uint t = 0; t < triangles.size(); t++) {
+        const glm::uvec3 &tri = triangles[t];
+        glm::vec3 normal = glm::cross(world_positions[tri[1]] - world_positions[tri[0]], world_positions[tri[2]] - world_positions[tri[0]]);
+        if (glm::dot(normal, normal) > 1e-20f)
+            kept.push_back(t);
+    }
+    std::vector<glm::vec3> centroids(triangles.size()), mins(triangles.size()), maxs(triangles.size());
+    _thread_pool.parallelFor(0, kept.size(), BVH_GRAIN, [&](uint _k) {
+        uint t = kept[_k];
+        const glm::vec3 &a = world_positions[triangles[t][0]], &b = world_positions[triangles[t][1]], &c = world_positions[triangles[t][2]];
+        mins[t] = glm::min(glm::min(a, b), c);
+        maxs[t] = glm::max(glm::max(a, b), c);
+        centroids[t] = (a + b + c) / 3.f;
+    });
+
+    m_nodes.clear();
+    m_nodes.reserve(2 * kept.size());
+    if (!kept.empty()) {
+        BVHNode root;
+        root.first = 0;
+        root.count = kept.size();
+        m_nodes.push_back(root);
+        subdivide(0, kept, centroids, mins, maxs, _thread_pool);
+    }
+    m_nodes.shrink_to_fit();
+
+    // copy the triangles in leaf order
+    m_triangle_indices = kept;
+    m_vertices.resize(3 * kept.size());
+    _thread_pool.parallelFor(0, kept.size(), BVH_GRAIN, [&](uint _k) {
+        for (uint j = 0; j < 3; j++)
+            m_vertices[3 * _k + j] = world_positions[triangles[kept[_k]][j]];
+    });
+}
+
+// Splits _nodes[_node] (bounds written), false if it stays a leaf. The children are appended to _nodes.
+static bool splitNode(std::vector<BVHNode> &_nodes, uint _node, uint _depth, std::vector<uint> &_triangles, const std::vector<glm::vec3> &_centroids,
+                      const std::vector<glm::vec3> &_mins, const std::vector<glm::vec3> &_maxs, ThreadPool &_thread_pool, std::vector<Bin> &_chunk_bins) {
+    const uint first = _nodes[_node].first, count = _nodes[_node].count;
+
+    // bounds of the node and of its centroids
+    Bin bounds, centroid_bounds;
+    for (uint k = first; k < first + count; k++) {
+        uint t = _triangles[k];
+        bounds.add(_mins[t], _maxs[t], 1);
+        centroid_bounds.add(_centroids[t], _centroids[t], 1);
+    }
+    _nodes[_node].min = bounds.min;
+    _nodes[_node].max = bounds.max;
+    glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    if (count <= MAX_LEAF_SIZE || _depth >= MAX_DEPTH || std::max(std::max(extent.x, extent.y), extent.z) <= 0.f)
+        return false; // leaf
+
+    // (1) per-chunk bins, combined in chunk order
+    glm::vec3 scale = glm::vec3(float(BIN_COUNT)) / glm::max(extent, glm::vec3(1e-30f));
+    uint chunk_count = ThreadPool::chunkCount(first, first + count, BVH_GRAIN);
+    _chunk_bins.assign(chunk_count * 3 * BIN_COUNT, Bin());
+    _thread_pool.parallelForChunks(first, first + count, BVH_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        Bin *bins = &_chunk_bins[_chunk * 3 * BIN_COUNT];
+        for (uint k = _begin; k < _end; k++) {
+            uint t = _triangles[k];
+            for (uint axis = 0; axis < 3; axis++) {
+                uint b = std::min(BIN_COUNT - 1, uint((_centroids[t][axis] - centroid_bounds.min[axis]) * scale[axis]));
+                bins[axis * BIN_COUNT + b].add(_mins[t], _maxs[t], 1);
+            }
+        }
+    });
+    Bin bins[3 * BIN_COUNT];
+    for (uint chunk = 0; chunk < chunk_count; chunk++)
+        for (uint b = 0; b < 3 * BIN_COUNT; b++)
+            bins[b].add(_chunk_bins[chunk * 3 * BIN_COUNT + b].min, _chunk_bins[chunk * 3 * BIN_COUNT + b].max, _chunk_bins[chunk * 3 * BIN_COUNT + b].count);
+
+    // (2) sweep the planes from both sides
+    float best_cost = FLT_MAX;
+    uint best_axis = 0, best_plane = 0;
+    for (uint axis = 0; axis < 3; axis++) {
+        const Bin *axis_bins = &bins[axis * BIN_COUNT];
+        float right_costs[BIN_COUNT];
+        Bin right;
+        for (uint b = BIN_COUNT - 1; b > 0; b--) {
+            right.add(axis_bins[b].min, axis_bins[b].max, axis_bins[b].count);
+            right_costs[b] = right.count * surfaceArea(right.min, right.max);
+        }
+        Bin left;
+        for (uint plane = 1; plane < BIN_COUNT; plane++) { // bins [0; plane[ on the left
+            left.add(axis_bins[plane - 1].min, axis_bins[plane - 1].max, axis_bins[plane - 1].count);
+            if (left.count == 0 || left.count == count)
+                continue;
+            float cost = left.count * surfaceArea(left.min, left.max) + right_costs[plane];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_plane = plane;
+            }
+        }
+    }
+
+    // (3)
+    uint middle;
+    if (best_cost < count * surfaceArea(bounds.min, bounds.max)) {
+        float min = centroid_bounds.min[best_axis], axis_scale = scale[best_axis];
+        uint *split = std::partition(&_triangles[first], &_triangles[first] + count, [&](uint _t) {
+            return std::min(BIN_COUNT - 1, uint((_centroids[_t][best_axis] - min) * axis_scale)) < best_plane;
+        });
+        middle = split - &_triangles[0];
+    } else {
+        // no plane beats a leaf, but the leaf would be too big: median split along the longest axis
+        uint axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        middle = first + count / 2;
+        std::nth_element(&_triangles[first], &_triangles[middle], &_triangles[first] + count, [&](uint _a, uint _b) {
+            return _centroids[_a][axis] < _centroids[_b][axis];
+        });
+    }
+
+    BVHNode left, right;
+    left.first = first;
+    left.count = middle - first;
+    right.first = middle;
+    right.count = first + count - middle;
+    _nodes[_node].first = _nodes.size();
+    _nodes[_node].count = 0;
+    _nodes.push_back(left);
+    _nodes.push_back(right);
+    return true;
+}
+
+/*
+(1) - (3) the nodes above BVH_SUBTREE_SIZE triangles are split on the calling thread (binning in parallel)
+(4) the subtrees below are built in parallel, each in its own array of nodes, then appended in order: the tree only
+    depends on the triangles
+*/
+void StaticBVH::subdivide(uint _root, std::vector<uint> &_triangles, const std::vector<glm::vec3> &_centroids,
+                          const std::vector<glm::vec3> &_mins, const std::vector<glm::vec3> &_maxs, ThreadPool &_thread_pool) {
+    std::vector<std::pair<uint, uint>> stack = {{_root, 0}}; // node, depth
+    std::vector<std::pair<uint, uint>> subtrees;             // root, depth
+    std::vector<Bin> chunk_bins;
+    while (!stack.empty()) {
+        uint node_index = stack.back().first, depth = stack.back().second;
+        stack.pop_back();
+        if (m_nodes[node_index].count <= BVH_SUBTREE_SIZE) {
+            subtrees.push_back({node_index, depth});
+            continue;
+        }
+        if (!splitNode(m_nodes, node_index, depth, _triangles, _centroids, _mins, _maxs, _thread_pool, chunk_bins))
+            continue;
+        stack.push_back({m_nodes[node_index].first + 1, depth + 1});
+        stack.push_back({m_nodes[node_index].first, depth + 1});
+    }
+
+    // (4) the subtrees cover disjoint ranges of _triangles, the binning nested in a task runs serially
+    std::vector<std::vector<BVHNode>> subtree_nodes(subtrees.size());
+    _thread_pool.parallelFor(0, subtrees.size(), 1, [&](uint _s) {
+        std::vector<BVHNode> &nodes = subtree_nodes[_s];
+        nodes.push_back(m_nodes[subtrees[_s].first]);
+        std::vector<std::pair<uint, uint>> local_stack = {{0, subtrees[_s].second}};
+        std::vector<Bin> local_chunk_bins;
+        while (!local_stack.empty()) {
+            uint node_index = local_stack.back().first, depth = local_stack.back().second;
+            local_stack.pop_back();
+            if (!splitNode(nodes, node_index, depth, _triangles, _centroids, _mins, _maxs, _thread_pool, local_chunk_bins))
+                continue;
+            local_stack.push_back({nodes[node_index].first + 1, depth + 1});
+            local_stack.push_back({nodes[node_index].first, depth + 1});
+        }
+    });
+    for (uint s = 0; s < subtrees.size(); s++) {
+        std::vector<BVHNode> &nodes = subtree_nodes[s];
+        const uint offset = m_nodes.size() - 1; // nodes[0] replaces the root of the subtree
+        for (BVHNode &node : nodes)
+            if (!node.isLeaf())
+                node.first += offset;
+        m_nodes[subtrees[s].first] = nodes[0];
+        m_nodes.insert(m_nodes.end(), nodes.begin() + 1, nodes.end());
+    }
+}
+
+// READ "5.1.5 Closest Point on Triangle to Point" of Real-Time Collision Detection (Ericson 2004)
+static glm::vec3 closestPointOnTriangle(const glm::vec3 &_p, const glm::vec3 &_a, const glm::vec3 &_b, const glm::vec3 &_c, bool &_inside) {
+    _inside = false;
+    glm::vec3 ab = _b - _a, ac = _c - _a, ap = _p - _a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.f && d2 <= 0.f)
+        return _a;
+    glm::vec3 bp = _p - _b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.f && d4 <= d3)
+        return _b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+        return _a + d1 / (d1 - d3) * ab;
+    glm::vec3 cp = _p - _c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.f && d5 <= d6)
+        return _c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+        return _a + d2 / (d2 - d6) * ac;
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+        return _b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (_c - _b);
+    _inside = true;
+    float denominator = 1.f / (va + vb + vc);
+    return _a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Möller-Trumbore, both faces, t in [0; 1]
+static bool segmentIntersectsTriangle(const glm::vec3 &_start, const glm::vec3 &_direction, const glm::vec3 &_a, const glm::vec3 &_b, const glm::vec3 &_c, float &_t) {
+    glm::vec3 ab = _b - _a, ac = _c - _a;
+    glm::vec3 p = glm::cross(_direction, ac);
+    float determinant = glm::dot(ab, p);
+    if (fabsf(determinant) < 1e-12f)
+        return false;
+    float inv_determinant = 1.f / determinant;
+    glm::vec3 s = _start - _a;
+    float u = glm::dot(s, p) * inv_determinant;
+    if (u < 0.f || u > 1.f)
+        return false;
+    glm::vec3 q = glm::cross(s, ab);
+    float v = glm::dot(_direction, q) * inv_determinant;
+    if (v < 0.f || u + v > 1.f)
+        return false;
+    _t = glm::dot(ac, q) * inv_determinant;
+    return _t >= 0.f && _t <= 1.f;
+}
+
+bool StaticBVH::collide(const glm::vec3 &_start, const glm::vec3 &_end, float _thickness, glm::vec3 &_point, glm::vec3 &_normal) const {
+    glm::vec3 direction = _end - _start;
+    float first_hit = FLT_MAX, closest_distance2 = _thickness * _thickness;
+    bool crossed = false, close = false;
+    forEachTriangleInBox(glm::min(_start, _end) - glm::vec3(_thickness), glm::max(_start, _end) + glm::vec3(_thickness), [&](uint _t) {
+        const glm::vec3 *v = triangle(_t);
+        glm::vec3 face_normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+        float start_side = glm::dot(_start - v[0], face_normal), end_side = glm::dot(_end - v[0], face_normal);
+        bool may_cross = (start_side >= 0.f) != (end_side >= 0.f);
+        if (!may_cross && end_side * end_side > closest_distance2 * glm::dot(face_normal, face_normal))
+            return; // the end stays on the side of the start, farther from the plane than the closest triangle so far
+        face_normal = glm::normalize(start_side < 0.f ? -face_normal : face_normal); // facing the start of the segment
+
+        float t;
+        if (may_cross && segmentIntersectsTriangle(_start, direction, v[0], v[1], v[2], t) && t < first_hit) {
+            first_hit = t;
+            crossed = true;
+            _point = _start + t * direction;
+            _normal = face_normal;
+        }
+        if (crossed)
+            return;
+
+        bool inside;
+        glm::vec3 closest = closestPointOnTriangle(_end, v[0], v[1], v[2], inside);
+        glm::vec3 offset = _end - closest;
+        float distance2 = glm::dot(offset, offset);
+        if (distance2 < closest_distance2) {
+            closest_distance2 = distance2;
+            close = true;
+            _point = closest;
+            _normal = inside || distance2 < 1e-12f ? face_normal : offset / sqrtf(distance2);
+        }
+    });
+    return crossed || close;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <vector>
+
+// 32 bytes, two nodes per cache line. The children of an inner node are stored next to each other.
+struct BVHNode {
+    glm::vec3 min;
+    uint first; // leaf: first triangle, inner node: left child (the right one is first + 1)
+    glm::vec3 max;
+    uint count; // number of triangles of a leaf, 0 for an inner node
+
+    inline bool isLeaf() const { return count > 0; }
+};
+
+// Contact found by StaticBVH::collide: the vertex must stay in front of the plane (point, normal)
+struct StaticContact {
+    uint vertex;
+    glm::vec3 point;
+    glm::vec3 normal;
+};
+
+/*
+Bounding volume hierarchy over the triangles of a static Mesh, built once.
+READ "On fast Construction of SAH-based Bounding Volume Hierarchies" (Wald 2007) for the binned SAH:
+(1) the centroids of the node are projected in BIN_COUNT bins along each axis
+(2) for each of the BIN_COUNT - 1 planes: cost = Nleft Aleft + Nright Aright (A: surface area)
+(3) the node is split along the cheapest plane (at the median of the longest axis if no plane beats Ntriangles Anode)
+    until it holds at most MAX_LEAF_SIZE triangles
+The binning of large nodes is parallel (per-chunk bins combined in chunk order), then the subtrees below
+BVH_SUBTREE_SIZE triangles are built as parallel tasks: the tree does not depend on the number of threads.
+The triangles are copied in leaf order, already transformed in world space.
+*/
+class StaticBVH {
+    std::vector<BVHNode> m_nodes;         // m_nodes[0] is the root
+    std::vector<glm::vec3> m_vertices;    // 3 per triangle, in leaf order
+    std::vector<uint> m_triangle_indices; // index in Mesh::triangleIndices of every triangle, in leaf order
+
+    void subdivide(uint _node, std::vector<uint> &_triangles, const std::vector<glm::vec3> &_centroids,
+                   const std::vector<glm::vec3> &_mins, const std::vector<glm::vec3> &_maxs, ThreadPool &_thread_pool);
+
+public:
+    void build(const Mesh &_mesh, const glm::mat4 &_model = glm::mat4(1.f), ThreadPool &_thread_pool = ThreadPool::global());
+
+    inline uint nodeCount() const { return m_nodes.size(); }
+    inline uint triangleCount() const { return m_triangle_indices.size(); }
+    inline bool empty() const { return m_nodes.empty(); }
+
+    static inline bool overlaps(const BVHNode &_node, const glm::vec3 &_min, const glm::vec3 &_max) {
+        return _node.min.x <= _max.x && _node.max.x >= _min.x && _node.min.y <= _max.y && _node.max.y >= _min.y && _node.min.z <= _max.z && _node.max.z >= _min.z;
+    }
+
+    // _f(uint _triangle) for every triangle (in leaf order) of the leaves overlapping the box [_min; _max]
+    template <class F>
+    inline void forEachTriangleInBox(const glm::vec3 &_min, const glm::vec3 &_max, const F &_f) const {
+        if (m_nodes.empty() || !overlaps(m_nodes[0], _min, _max))
+            return;
+        // the children are tested before being pushed, both are in the same cache line most of the time
+        uint stack[64];
+        uint stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const BVHNode &node = m_nodes[stack[--stack_size]];
+            if (node.isLeaf()) {
+                for (uint t = node.first; t < node.first + node.count; t++)
+                    _f(t);
+                continue;
+            }
+            if (overlaps(m_nodes[node.first + 1], _min, _max))
+                stack[stack_size++] = node.first + 1;
+            if (overlaps(m_nodes[node.first], _min, _max))
+                stack[stack_size++] = node.first;
+        }
+    }
+
+    inline const glm::vec3 *triangle(uint _t) const { return &m_vertices[3 * _t]; }
+
+    /*
+    Contact of a vertex going from _start (xi) to _end (pi) with the surface, thickness _thickness (h) included:
+    - the segment crosses a triangle: the plane of the first triangle crossed, facing _start
+    - otherwise the closest triangle to _end if it is closer than h: the plane through its closest point,
+      facing _end (the face normal, on the side of _start, when _end projects inside the triangle)
+    */
+    bool collide(const glm::vec3 &_start, const glm::vec3 &_end, float _thickness, glm::vec3 &_point, glm::vec3 &_normal) const;
+};
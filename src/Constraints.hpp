@@ -0,0 +1,589 @@
+#pragma once
+
+#include "VertexArrays.hpp"
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+enum ConstraintType {
+    EQUALITY_CONSTRAINT,
+    INEQUALITY_CONSTRAINT,
+};
+
+// Outcome of the projection of one or several constraints
+struct ProjectionResult {
+    float evolution = 0.f; // sum of the mean displacements
+    float residual = 0.f;  // max |Cj| before projection (only the violation for inequality constraints)
+
+    inline void add(const ProjectionResult &_other) {
+        evolution += _other.evolution;
+        residual = std::max(residual, _other.residual);
+    }
+};
+
+// Compliance passed to ConstraintBatch::add and grow (and the add*Constraint of DynamicObject) to derive αj from kj
+static const float DERIVED_COMPLIANCE = -1.f;
+
+// αj with which the first XPBD iteration corrects the same fraction kj of Cj as one PBD projection, for ∑ wi |∇Ci|² = 1
+// and ∆t = 1 / 60 s: ∆λ = -Cj / (1 + α̃) with α̃ = (1 - kj) / kj. kj = 1 -> 0 (rigid), kj is clamped to 1e-6 (α̃ stays finite).
+inline float complianceFromStiffness(float _stiffness) {
+    const float reference_dt = 1.f / 60.f;
+    const float stiffness = glm::clamp(_stiffness, 1e-6f, 1.f);
+    return (1.f - stiffness) / stiffness * reference_dt * reference_dt;
+}
+
+/*
+Built-in constraint families, stored as structure of arrays.
+Each family knows its cardinality at compile time and exposes an inlined
+    float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const
+which reads the predicted positions directly and returns Cj while filling ∇Cj for every impacted vertex.
+*/
+template <uint Cardinality>
+struct ConstraintBatch {
+    static const uint cardinality = Cardinality;
+
+    std::vector<std::array<uint, Cardinality>> indices; // Indices of impacted vertices
+    std::vector<float> stiffnesses;                     // kj: Strength in [0;1] (PBD)
+    std::vector<float> compliances;                     // αj: Inverse stiffness (XPBD), 0 -> infinitely stiff, see complianceFromStiffness
+    std::vector<float> lambdas;                         // λj: Lagrange multipliers (XPBD), reset at every substep
+
+    // Graph coloring: constraints in [color_offsets[c]; color_offsets[c + 1][ share no vertex.
+    // Empty when the batch has not been colored (or has been modified since).
+    std::vector<uint> color_offsets;
+
+    inline uint size() const { return indices.size(); }
+    inline uint colorCount() const { return color_offsets.empty() ? 0 : color_offsets.size() - 1; }
+    inline size_t capacity() const { return indices.capacity(); } // the arrays grow together
+
+    inline void add(const std::array<uint, Cardinality> &_indices, float _stiffness, float _compliance) {
+        indices.push_back(_indices);
+        stiffnesses.push_back(_stiffness);
+        compliances.push_back(_compliance < 0.f ? complianceFromStiffness(_stiffness) : _compliance);
+        lambdas.push_back(0.f);
+        color_offsets.clear();
+    }
+
+    // Bulk builds: appends _count constraints whose indices (and rest values) are then written in place by the caller,
+    // returns the index of the first one
+    inline uint grow(uint _count, float _stiffness, float _compliance) {
+        uint first = size();
+        indices.resize(first + _count);
+        stiffnesses.resize(first + _count, _stiffness);
+        compliances.resize(first + _count, _compliance < 0.f ? complianceFromStiffness(_stiffness) : _compliance);
+        lambdas.resize(first + _count, 0.f);
+        color_offsets.clear();
+        return first;
+    }
+
+    inline void resetLambdas() { std::fill(lambdas.begin(), lambdas.end(), 0.f); }
+
+    /*
+    Greedy coloring of the constraint graph (two constraints are adjacent if they share a vertex).
+    Colors are searched by blocks of 64 with one bitmask per vertex.
+    Fills color_offsets and returns the order which groups the constraints by color (see permute).
+    */
+    std::vector<uint> computeColoring(uint _vertex_count) {
+        std::vector<uint> colors(size(), UINT_MAX);
+        std::vector<uint64_t> vertex_masks;
+        uint remaining = size();
+        uint color_count = 0;
+        for (uint base = 0; remaining > 0; base += 64) {
+            vertex_masks.assign(_vertex_count, 0);
+            for (uint ci = 0; ci < size(); ci++) {
+                if (colors[ci] != UINT_MAX)
+                    continue;
+                uint64_t used = 0;
+                for (uint i = 0; i < Cardinality; i++)
+                    used |= vertex_masks[indices[ci][i]];
+                if (~used == 0)
+                    continue; // every color of this block is taken, try the next block
+                uint color = __builtin_ctzll(~used);
+                for (uint i = 0; i < Cardinality; i++)
+                    vertex_masks[indices[ci][i]] |= uint64_t(1) << color;
+                colors[ci] = base + color;
+                color_count = std::max(color_count, base + color + 1);
+                remaining--;
+            }
+        }
+
+        // counting sort by color
+        color_offsets.assign(color_count + 1, 0);
+        for (uint ci = 0; ci < size(); ci++)
+            color_offsets[colors[ci] + 1]++;
+        for (uint c = 0; c < color_count; c++)
+            color_offsets[c + 1] += color_offsets[c];
+        std::vector<uint> order(size());
+        std::vector<uint> cursors(color_offsets.begin(), color_offsets.end() - 1);
+        for (uint ci = 0; ci < size(); ci++)
+            order[cursors[colors[ci]]++] = ci;
+        return order;
+    }
+
+protected:
+    // _array[i] <- _array[_order[i]]
+    template <class T>
+    static void applyPermutation(std::vector<T> &_array, const std::vector<uint> &_order) {
+        std::vector<T> permuted(_array.size());
+        for (uint i = 0; i < _order.size(); i++)
+            permuted[i] = _array[_order[i]];
+        _array.swap(permuted);
+    }
+
+    void reserveBase(uint _count) {
+        indices.reserve(_count);
+        stiffnesses.reserve(_count);
+        compliances.reserve(_count);
+        lambdas.reserve(_count);
+    }
+
+    void permuteBase(const std::vector<uint> &_order) {
+        applyPermutation(indices, _order);
+        applyPermutation(stiffnesses, _order);
+        applyPermutation(compliances, _order);
+        applyPermutation(lambdas, _order);
+    }
+};
+
+// C(p0, p1) = |p0 - p1| - d
+struct DistanceConstraints : ConstraintBatch<2> {
+    static const ConstraintType type = EQUALITY_CONSTRAINT;
+    std::vector<float> rest_lengths; // d
+
+    inline float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const {
+        const std::array<uint, 2> &idx = indices[_ci];
+        glm::vec3 p01 = _p[idx[0]] - _p[idx[1]];
+        float length = glm::length(p01);
+        glm::vec3 n = length > 1e-12f ? p01 / length : glm::vec3(0.f);
+        _gradients[0] = n;
+        _gradients[1] = -n;
+        return length - rest_lengths[_ci];
+    }
+
+    void permute(const std::vector<uint> &_order) {
+        permuteBase(_order);
+        applyPermutation(rest_lengths, _order);
+    }
+
+    void clear() {
+        indices.clear();
+        stiffnesses.clear();
+        compliances.clear();
+        lambdas.clear();
+        color_offsets.clear();
+        rest_lengths.clear();
+    }
+};
+
+// "Appendix A: Bending Constraint Projection" of ./articles/Position_Based_Dynamics.pdf
+// Triangles (p0, p2, p1) and (p0, p1, p3) share the edge (p0, p1)
+// C(p0, p1, p2, p3) = acos(n1 . n2) - φ0
+struct BendingConstraints : ConstraintBatch<4> {
+    static const ConstraintType type = EQUALITY_CONSTRAINT;
+    std::vector<float> rest_angles; // φ0
+
+    static inline float dihedralAngle(const glm::vec3 &_p0, const glm::vec3 &_p1, const glm::vec3 &_p2, const glm::vec3 &_p3) {
+        glm::vec3 n1 = glm::cross(_p1 - _p0, _p2 - _p0);
+        glm::vec3 n2 = glm::cross(_p1 - _p0, _p3 - _p0);
+        float l1 = glm::length(n1), l2 = glm::length(n2);
+        if (l1 < 1e-12f || l2 < 1e-12f)
+            return 0.f;
+        return acosf(glm::clamp(glm::dot(n1, n2) / (l1 * l2), -1.f, 1.f));
+    }
+
+    inline float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const {
+        const std::array<uint, 4> &idx = indices[_ci];
+        glm::vec3 p1 = _p[idx[1]] - _p[idx[0]];
+        glm::vec3 p2 = _p[idx[2]] - _p[idx[0]];
+        glm::vec3 p3 = _p[idx[3]] - _p[idx[0]];
+
+        glm::vec3 c12 = glm::cross(p1, p2), c13 = glm::cross(p1, p3);
+        float l12 = glm::length(c12), l13 = glm::length(c13);
+        if (l12 < 1e-12f || l13 < 1e-12f) {
+            _gradients[0] = _gradients[1] = _gradients[2] = _gradients[3] = glm::vec3(0.f);
+            return 0.f;
+        }
+        glm::vec3 n1 = c12 / l12, n2 = c13 / l13;
+        float d = glm::clamp(glm::dot(n1, n2), -1.f, 1.f);
+
+        // -∂d/∂pi (qi in the article)
+        glm::vec3 q2 = (glm::cross(p1, n2) + glm::cross(n1, p1) * d) / l12;
+        glm::vec3 q3 = (glm::cross(p1, n1) + glm::cross(n2, p1) * d) / l13;
+        glm::vec3 q1 = -(glm::cross(p2, n2) + glm::cross(n1, p2) * d) / l12 - (glm::cross(p3, n1) + glm::cross(n2, p3) * d) / l13;
+        glm::vec3 q0 = -q1 - q2 - q3;
+
+        // ∇acos(d) = -∇d / sqrt(1 - d²) = qi / sqrt(1 - d²)
+        float sine = sqrtf(1.f - d * d);
+        float factor = sine > 1e-6f ? 1.f / sine : 0.f;
+        _gradients[0] = factor * q0;
+        _gradients[1] = factor * q1;
+        _gradients[2] = factor * q2;
+        _gradients[3] = factor * q3;
+        return acosf(d) - rest_angles[_ci];
+    }
+
+    void permute(const std::vector<uint> &_order) {
+        permuteBase(_order);
+        applyPermutation(rest_angles, _order);
+    }
+
+    void clear() {
+        indices.clear();
+        stiffnesses.clear();
+        compliances.clear();
+        lambdas.clear();
+        color_offsets.clear();
+        rest_angles.clear();
+    }
+};
+
+// Signed volume of the tetrahedron (p0, p1, p2, p3)
+// C(p0, p1, p2, p3) = (p1 - p0) x (p2 - p0) . (p3 - p0) / 6 - V0
+struct VolumeConstraints : ConstraintBatch<4> {
+    static const ConstraintType type = EQUALITY_CONSTRAINT;
+    std::vector<float> rest_volumes; // V0
+
+    static inline float volume(const glm::vec3 &_p0, const glm::vec3 &_p1, const glm::vec3 &_p2, const glm::vec3 &_p3) {
+        return glm::dot(glm::cross(_p1 - _p0, _p2 - _p0), _p3 - _p0) / 6.f;
+    }
+
+    inline float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const {
+        const std::array<uint, 4> &idx = indices[_ci];
+        glm::vec3 p01 = _p[idx[1]] - _p[idx[0]];
+        glm::vec3 p02 = _p[idx[2]] - _p[idx[0]];
+        glm::vec3 p03 = _p[idx[3]] - _p[idx[0]];
+        _gradients[1] = glm::cross(p02, p03) / 6.f;
+        _gradients[2] = glm::cross(p03, p01) / 6.f;
+        _gradients[3] = glm::cross(p01, p02) / 6.f;
+        _gradients[0] = -_gradients[1] - _gradients[2] - _gradients[3];
+        return glm::dot(glm::cross(p01, p02), p03) / 6.f - rest_volumes[_ci];
+    }
+
+    void permute(const std::vector<uint> &_order) {
+        permuteBase(_order);
+        applyPermutation(rest_volumes, _order);
+    }
+
+    void clear() {
+        indices.clear();
+        stiffnesses.clear();
+        compliances.clear();
+        lambdas.clear();
+        color_offsets.clear();
+        rest_volumes.clear();
+    }
+};
+
+// Pins a vertex to a point of the world
+// C(p0) = |p0 - target|
+struct AttachmentConstraints : ConstraintBatch<1> {
+    static const ConstraintType type = EQUALITY_CONSTRAINT;
+    std::vector<glm::vec3> targets;
+
+    inline float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const {
+        glm::vec3 offset = _p[indices[_ci][0]] - targets[_ci];
+        float length = glm::length(offset);
+        _gradients[0] = length > 1e-12f ? offset / length : glm::vec3(0.f);
+        return length;
+    }
+
+    void permute(const std::vector<uint> &_order) {
+        permuteBase(_order);
+        applyPermutation(targets, _order);
+    }
+
+    void clear() {
+        indices.clear();
+        stiffnesses.clear();
+        compliances.clear();
+        lambdas.clear();
+        color_offsets.clear();
+        targets.clear();
+    }
+};
+
+// Transient self collision between two particles, generated at every step by the broad phase
+// C(p0, p1) = (p0 - p1) . n - h >= 0
+// n is the direction from p1 to p0 at the time of impact (the particles may have crossed each other by the end of the step)
+struct ParticleContactConstraints : ConstraintBatch<2> {
+    static const ConstraintType type = INEQUALITY_CONSTRAINT;
+    std::vector<glm::vec3> normals; // n
+    float thickness = 0.f;          // h
+
+    // Time of impact of two particles moving linearly during the step: the earliest t in [0; 1] with
+    // |d0 + t (d1 - d0)| = h, where d0 = xi - xj at the start of the step and d1 = pi - pj at its end
+    static inline bool timeOfImpact(const glm::vec3 &_d0, const glm::vec3 &_d1, float _h, float &_t) {
+        glm::vec3 dd = _d1 - _d0;
+        float c = glm::dot(_d0, _d0) - _h * _h;
+        if (c <= 0.f) { // already in contact at the start of the step
+            _t = 0.f;
+            return true;
+        }
+        float a = glm::dot(dd, dd), half_b = glm::dot(_d0, dd);
+        if (half_b >= 0.f || a < 1e-12f)
+            return false; // moving apart
+        float discriminant = half_b * half_b - a * c;
+        if (discriminant < 0.f)
+            return false; // closest approach farther than h
+        _t = (-half_b - sqrtf(discriminant)) / a;
+        return _t <= 1.f;
+    }
+
+    inline float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const {
+        const std::array<uint, 2> &idx = indices[_ci];
+        const glm::vec3 &n = normals[_ci];
+        _gradients[0] = n;
+        _gradients[1] = -n;
+        return glm::dot(_p[idx[0]] - _p[idx[1]], n) - thickness;
+    }
+
+    void permute(const std::vector<uint> &_order) {
+        permuteBase(_order);
+        applyPermutation(normals, _order);
+    }
+
+    void clear() {
+        indices.clear();
+        stiffnesses.clear();
+        compliances.clear();
+        lambdas.clear();
+        color_offsets.clear();
+        normals.clear();
+    }
+};
+
+// Transient collision of a vertex with a static surface: p0 must stay in front of the plane (q, n)
+// C(p0) = (p0 - q) . n - h >= 0
+struct StaticContactConstraints : ConstraintBatch<1> {
+    static const ConstraintType type = INEQUALITY_CONSTRAINT;
+    std::vector<glm::vec3> points;  // q
+    std::vector<glm::vec3> normals; // n
+    float thickness = 0.f;          // h
+
+    inline float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const {
+        _gradients[0] = normals[_ci];
+        return glm::dot(_p[indices[_ci][0]] - points[_ci], normals[_ci]) - thickness;
+    }
+
+    void permute(const std::vector<uint> &_order) {
+        permuteBase(_order);
+        applyPermutation(points, _order);
+        applyPermutation(normals, _order);
+    }
+
+    void reserve(uint _count) {
+        reserveBase(_count);
+        points.reserve(_count);
+        normals.reserve(_count);
+    }
+
+    void clear() {
+        indices.clear();
+        stiffnesses.clear();
+        compliances.clear();
+        lambdas.clear();
+        color_offsets.clear();
+        points.clear();
+        normals.clear();
+    }
+};
+
+// "4.4 Cloth Self Collision" of ./articles/Position_Based_Dynamics.pdf
+// Transient collision between the vertex p0 and the triangle (p1, p2, p3): p0 must stay on the side it came from
+// C(p0, p1, p2, p3) = σ (p0 - ∑k bk pk) . n - h >= 0 with n = (p2 - p1) x (p3 - p1) / |(p2 - p1) x (p3 - p1)|
+// σ = ±1 is the side of p0 at the start of the step and bk the barycentric coordinates of the closest point of the triangle
+// (of the point of impact when p0 went through the triangle during the step).
+// n is considered constant when deriving, so ∇p0 C = σ n and ∇pk C = -bk σ n.
+struct TriangleContactConstraints : ConstraintBatch<4> {
+    static const ConstraintType type = INEQUALITY_CONSTRAINT;
+    std::vector<glm::vec3> barycentrics; // bk
+    std::vector<float> sides;            // σ
+    float thickness = 0.f;               // h
+
+    inline float evaluate(uint _ci, const glm::vec3 *_p, glm::vec3 *_gradients) const {
+        const std::array<uint, 4> &idx = indices[_ci];
+        const glm::vec3 &p1 = _p[idx[1]], &p2 = _p[idx[2]], &p3 = _p[idx[3]];
+        glm::vec3 normal = glm::cross(p2 - p1, p3 - p1);
+        float area = glm::length(normal);
+        if (area < 1e-12f) {
+            _gradients[0] = _gradients[1] = _gradients[2] = _gradients[3] = glm::vec3(0.f);
+            return 0.f;
+        }
+        glm::vec3 n = sides[_ci] / area * normal;
+        const glm::vec3 &b = barycentrics[_ci];
+        _gradients[0] = n;
+        _gradients[1] = -b[0] * n;
+        _gradients[2] = -b[1] * n;
+        _gradients[3] = -b[2] * n;
+        return glm::dot(_p[idx[0]] - (b[0] * p1 + b[1] * p2 + b[2] * p3), n) - thickness;
+    }
+
+    void permute(const std::vector<uint> &_order) {
+        permuteBase(_order);
+        applyPermutation(barycentrics, _order);
+        applyPermutation(sides, _order);
+    }
+
+    void clear() {
+        indices.clear();
+        stiffnesses.clear();
+        compliances.clear();
+        lambdas.clear();
+        color_offsets.clear();
+        barycentrics.clear();
+        sides.clear();
+    }
+};
+
+/*
+READ "Meshless Deformations Based on Shape Matching" (Müller 2005), "3.3 Shape Matching".
+Overlapping clusters of vertices, each of them pulled towards a rigid motion of its rest shape:
+    c = ∑i mi pi / ∑i mi                      (center of the cluster)
+    Apq = ∑i mi (pi - c) qiT                  (qi = x0i - c0: rest offsets)
+    R = rotational part of Apq               (see MatrixKernels::extractRotations, warm-started from the last step)
+    gi = R qi + c                            (goal positions)
+    ∆pi = k (gi - pi)
+Not a scalar constraint: the clusters are projected by DynamicObject::projectShapeMatching, the stiffness k is used
+by PBD and XPBD alike.
+*/
+struct ShapeMatchingClusters {
+    std::vector<uint> offsets = {0};     // CSR: the vertices of cluster c are indices[offsets[c]; offsets[c + 1][
+    std::vector<uint> indices;           //
+    std::vector<glm::vec3> rest_offsets; // qi of every (cluster, vertex) pair
+    std::vector<float> masses;           // ∑i mi of every cluster
+    std::vector<float> stiffnesses;      // k: Strength in [0;1]
+
+    // Per-step workspace, one lane per cluster
+    std::vector<glm::vec3> centers;      // c
+    std::vector<glm::vec3> rest_anchors; // mean qi of the fixed vertices of the cluster, 0 if none
+    Mat3Arrays matrices;                 // Apq, then R
+    QuatArrays rotations;                // R as a quaternion, kept from one step to the next
+    std::vector<glm::vec3> deltas;       // ∆pi of every (cluster, vertex) pair
+
+    // Vertex -> pairs: the pairs of vertex i are vertex_pairs[vertex_offsets[i]; vertex_offsets[i + 1][
+    std::vector<uint> vertex_offsets;
+    std::vector<uint> vertex_pairs;
+
+    inline uint size() const { return offsets.size() - 1; }
+    inline uint pairCount() const { return indices.size(); }
+
+    // _positions and _masses are indexed by vertex, the rest shape is the current one
+    void add(const std::vector<uint> &_indices, const glm::vec3 *_positions, const float *_masses, float _stiffness) {
+        glm::vec3 center = glm::vec3(0.f);
+        float mass = 0.f;
+        for (uint i : _indices) {
+            center += _masses[i] * _positions[i];
+            mass += _masses[i];
+        }
+        center /= std::max(mass, 1e-12f);
+        for (uint i : _indices) {
+            indices.push_back(i);
+            rest_offsets.push_back(_positions[i] - center);
+        }
+        offsets.push_back(indices.size());
+        masses.push_back(mass);
+        stiffnesses.push_back(_stiffness);
+    }
+
+    // Sizes the workspace and builds the vertex -> pairs adjacency (counting sort, the pairs of a vertex stay in order)
+    void reserve(uint _vertex_count) {
+        centers.resize(size());
+        rest_anchors.resize(size());
+        matrices.resize(size());
+        rotations.resize(size());
+        deltas.resize(pairCount());
+        vertex_offsets.assign(_vertex_count + 1, 0);
+        for (uint i : indices)
+            vertex_offsets[i + 1]++;
+        for (uint i = 0; i < _vertex_count; i++)
+            vertex_offsets[i + 1] += vertex_offsets[i];
+        vertex_pairs.resize(pairCount());
+        std::vector<uint> cursors(vertex_offsets.begin(), vertex_offsets.end() - 1);
+        for (uint pair = 0; pair < pairCount(); pair++)
+            vertex_pairs[cursors[indices[pair]]++] = pair;
+    }
+
+    void clear() {
+        offsets.assign(1, 0);
+        indices.clear();
+        rest_offsets.clear();
+        masses.clear();
+        stiffnesses.clear();
+        centers.clear();
+        rest_anchors.clear();
+        matrices.resize(0);
+        rotations.clear();
+        deltas.clear();
+        vertex_offsets.clear();
+        vertex_pairs.clear();
+    }
+};
+
+/*
+READ "3.3. Constraint Projection" of ./articles/Position_Based_Dynamics.pdf
+PBD:  s = C(p) / ∑j wj |∇pj C(p)|²
+      ∆pi = -k s wi ∇pi C(p)
+READ "3. Our Method" of ./articles/Extended_Position_Based_Dynamics.pdf (Eq. 17, 18)
+XPBD: α̃ = α / ∆t²
+      ∆λ = (-C(p) - α̃ λ) / (∑j wj |∇pj C(p)|² + α̃)
+      ∆pi = wi ∇pi C(p) ∆λ
+Computes the corrections ∆pi of the constraint _ci of _batch without applying them.
+_inv_dt2 = 1 / ∆t² selects XPBD (and updates λ), 0 selects PBD.
+*/
+template <class Batch>
+inline ProjectionResult computeConstraintDeltas(Batch &_batch, uint _ci, const glm::vec3 *_p, const float *_w, float _inv_dt2, glm::vec3 *_deltas) {
+    const uint n = Batch::cardinality;
+    glm::vec3 gradients[n];
+    float function_value = _batch.evaluate(_ci, _p, gradients);
+
+    const std::array<uint, n> &idx = _batch.indices[_ci];
+    float denominator = 0.f;
+    for (uint i = 0; i < n; i++)
+        denominator += _w[idx[i]] * glm::dot(gradients[i], gradients[i]);
+
+    // Inequality constraints which are already satisfied are not projected
+    ProjectionResult result;
+    float alpha = _batch.compliances[_ci] * _inv_dt2; // α̃
+    if ((Batch::type == INEQUALITY_CONSTRAINT && function_value >= 0.f) || denominator + alpha < 1e-12f) {
+        for (uint i = 0; i < n; i++)
+            _deltas[i] = glm::vec3(0.f);
+        return result;
+    }
+    result.residual = fabsf(function_value);
+
+    float s; // ∆pi = -s wi ∇pi C(p)
+    if (_inv_dt2 > 0.f) {
+        float &lambda = _batch.lambdas[_ci];
+        float delta_lambda = (-function_value - alpha * lambda) / (denominator + alpha);
+        lambda += delta_lambda;
+        s = -delta_lambda;
+    } else {
+        s = _batch.stiffnesses[_ci] * function_value / denominator;
+    }
+
+    for (uint i = 0; i < n; i++) {
+        _deltas[i] = -s * _w[idx[i]] * gradients[i];
+        result.evolution += glm::length(_deltas[i]);
+    }
+    result.evolution /= n;
+    return result;
+}
+
+// Projects the constraint _ci of _batch in place (Gauss-Seidel)
+template <class Batch>
+inline ProjectionResult projectConstraint(Batch &_batch, uint _ci, glm::vec3 *_p, const float *_w, float _inv_dt2) {
+    glm::vec3 deltas[Batch::cardinality];
+    ProjectionResult result = computeConstraintDeltas(_batch, _ci, _p, _w, _inv_dt2, deltas);
+    if (result.evolution == 0.f)
+        return result;
+    for (uint i = 0; i < Batch::cardinality; i++)
+        _p[_batch.indices[_ci][i]] += deltas[i];
+    return result;
+}
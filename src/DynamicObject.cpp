@@ -1,11 +1,27 @@
 #include "DynamicObject.hpp"
+#include "AllocationCounter.hpp"
+#include "Profiler.hpp"
 #include <glm/matrix.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
 #include <iostream>
+#include <type_traits>
 
 float length2(const glm::vec3 &vec) {
     return vec.x * vec.x + vec.y * vec.y + vec.z * vec.z;
 }
 
+// Number of constraints per parallel task
+static const uint CONSTRAINT_GRAIN = 256;
+// Number of vertices per parallel task of the per-vertex kernels (multiple of SIMD_WIDTH)
+static const uint VERTEX_GRAIN = 4096;
+// Number of vertices (or triangles) per parallel task of the collision detection
+static const uint COLLISION_GRAIN = 1024;
+// Number of shape matching clusters per parallel task (multiple of SIMD_WIDTH)
+static const uint CLUSTER_GRAIN = 64;
+
 /*
 READ "3.5. Damping" of ./articles/Position_Based_Dynamics.pdf
 (1) xcm = (∑i xi*mi )/( ∑i mi )
@@ -17,54 +33,670 @@ READ "3.5. Damping" of ./articles/Position_Based_Dynamics.pdf
 (7) ∆vi = vcm + ω × ri − vi
 (8) vi ← vi + kdamping ∆vi
 (9) endfor
+
+(1)-(4) are reduced in a single parallel pass: every chunk of vertices sums mi, mi xi, mi vi, xi × mi vi and mi xi xiT
+(xi taken relative to x0 to limit the cancellation), then ri = xi − xcm is substituted afterwards:
+    L = ∑i xi × mi vi − xcm × ∑i mi vi
+    I = tr(S) Id − S    with S = ∑i mi ri riT = ∑i mi xi xiT − (∑i mi) xcm xcmT
+The chunks only depend on N and are combined in their order, so the result is the same for any number of threads.
 */
 void DynamicObject::dampVelocities(float k_damping) {
-    float total_mass = 0.f;
-    glm::vec3 xcm = glm::vec3(0.); // (1) : global linear velocity
-    glm::vec3 vcm = glm::vec3(0.); // (2)
-    for (uint i = 0; i < N; i++) {
-        if (m_fixed[i])
-            continue;
-        xcm += m_positions[i] * m_masses[i];  // (1)
-        vcm += m_velocities[i] * m_masses[i]; // (2)
-        total_mass += m_masses[i];
-    }
+    if (N == 0)
+        return;
 
-    if (total_mass == 0.f) {
-        return; // Nothing to damp
-    }
+    const glm::vec3 origin = m_positions.get(0);
+    const float *x = m_positions.x.data(), *y = m_positions.y.data(), *z = m_positions.z.data();
+    float *vx = m_velocities.x.data(), *vy = m_velocities.y.data(), *vz = m_velocities.z.data();
+    const float *masses = m_masses.data(), *weights = m_weights.data();
 
-    xcm /= total_mass; // (1)
-    vcm /= total_mass; // (2)
+    MassMoments *chunk_moments = m_chunk_moments.data();
+    m_thread_pool->parallelForChunks(0, N, VERTEX_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        MassMoments moments;
+        for (uint i = _begin; i < _end; i++) {
+            float mi = weights[i] > 0.f ? masses[i] : 0.f; // fixed vertices are ignored
+            glm::vec3 xi = glm::vec3(x[i], y[i], z[i]) - origin;
+            glm::vec3 mvi = mi * glm::vec3(vx[i], vy[i], vz[i]);
+            moments.mass += mi;
+            moments.position += mi * xi;                             // (1)
+            moments.velocity += mvi;                                 // (2)
+            moments.angular_momentum += glm::cross(xi, mvi);         // (3)
+            moments.second_moment += glm::outerProduct(mi * xi, xi); // (4)
+        }
+        chunk_moments[_chunk] = moments;
+    });
+    MassMoments total;
+    for (uint chunk = 0; chunk < ThreadPool::chunkCount(0, N, VERTEX_GRAIN); chunk++)
+        total.add(chunk_moments[chunk]);
 
-    glm::vec3 L = glm::vec3(0.); // (3)
-    glm::mat3 I = glm::mat3(0.); // (4)
-    for (uint i = 0; i < N; i++) {
-        if (m_fixed[i])
-            continue;
-        glm::vec3 ri = m_positions[i] - xcm;
-        // (3)
-        L += glm::cross(ri, m_masses[i] * m_velocities[i]);
-        // (4)
-        // glm::mat3 r_tilde_i = glm::mat3(0, -ri.z, ri.y, ri.z, 0, -ri.x, -ri.y, ri.x, 0);
-        // I += r_tilde_i * glm::transpose(r_tilde_i) * m_masses[i];
-        I += m_masses[i] * glm::mat3(ri.y * ri.y + ri.z * ri.z, -ri.x * ri.y, -ri.x * ri.z, -ri.x * ri.y, ri.x * ri.x + ri.z * ri.z, -ri.y * ri.z, -ri.x * ri.z, -ri.y * ri.z, ri.x * ri.x + ri.y * ri.y);
+    if (total.mass == 0.f) {
+        return; // Nothing to damp
     }
 
+    glm::vec3 xcm = total.position / total.mass;                            // (1) : relative to the origin
+    glm::vec3 vcm = total.velocity / total.mass;                            // (2) : global linear velocity
+    glm::vec3 L = total.angular_momentum - glm::cross(xcm, total.velocity); // (3)
+    glm::mat3 S = total.second_moment - total.mass * glm::outerProduct(xcm, xcm);
+    glm::mat3 I = (S[0][0] + S[1][1] + S[2][2]) * glm::mat3(1.f) - S; // (4)
+
     // check invertibility
     if (fabs(glm::determinant(I)) < 1e-8f) {
         return;
     }
     glm::vec3 omega = glm::inverse(I) * L; // (5): angular velocity
+    xcm += origin;
 
     // (6)-(9)
-    for (uint i = 0; i < N; i++) {
-        if (m_fixed[i])
+    m_thread_pool->parallelForChunks(0, N, VERTEX_GRAIN, [&](uint, uint _begin, uint _end) {
+        for (uint i = _begin; i < _end; i++) {
+            float k = weights[i] > 0.f ? k_damping : 0.f; // fixed vertices keep their velocity
+            glm::vec3 ri = glm::vec3(x[i], y[i], z[i]) - xcm;
+            glm::vec3 vi = glm::vec3(vx[i], vy[i], vz[i]);
+            glm::vec3 dvi = vcm + glm::cross(omega, ri) - vi; // (7)
+            vx[i] += k * dvi.x;                               // (8)
+            vy[i] += k * dvi.y;
+            vz[i] += k * dvi.z;
+        }
+    });
+}
+
+template <class Batch>
+static uint chunkCount(const Batch &_batch) {
+    return ThreadPool::chunkCount(0, _batch.size(), CONSTRAINT_GRAIN);
+}
+
+void DynamicObject::reserveWorkspace() {
+    m_new_positions.resize(paddedSize(N)); // the padding vertices are fixed at the origin
+    m_previous_positions.resize(N);
+
+    uint max_cardinality = 0;
+    for (uint cardinality : m_cardinalities)
+        max_cardinality = std::max(max_cardinality, cardinality);
+    m_affected_points.resize(max_cardinality);
+    m_affected_gradients.resize(max_cardinality);
+
+    // the colors are ranges of their batch so they never need more chunks than the whole batch
+    uint max_chunk_count = std::max(std::max(chunkCount(m_distance_constraints), chunkCount(m_bending_constraints)),
+                                    std::max(chunkCount(m_volume_constraints), chunkCount(m_attachment_constraints)));
+    max_chunk_count = std::max(max_chunk_count, ThreadPool::chunkCount(0, m_shape_matching.size(), CLUSTER_GRAIN));
+    m_chunk_results.resize(max_chunk_count);
+    m_shape_matching.reserve(N);
+    m_chunk_moments.resize(ThreadPool::chunkCount(0, N, VERTEX_GRAIN));
+    m_chunk_energies.resize(ThreadPool::chunkCount(0, N, VERTEX_GRAIN));
+
+    // the chunk outputs keep their capacity from one step to the next
+    m_chunk_particle_contacts.resize(ThreadPool::chunkCount(0, N, COLLISION_GRAIN));
+    m_chunk_triangle_contacts.resize(ThreadPool::chunkCount(0, m_triangles.size(), COLLISION_GRAIN));
+    m_chunk_static_contacts.resize(ThreadPool::chunkCount(0, N, COLLISION_GRAIN));
+    for (std::vector<StaticContact> &contacts : m_chunk_static_contacts)
+        contacts.reserve(COLLISION_GRAIN); // at most one contact per vertex and collider
+    m_static_contacts.reserve(N * m_colliders.size());
+    m_chunk_sweeps.resize(ThreadPool::chunkCount(0, N, COLLISION_GRAIN));
+    m_swept_mins.resize(N);
+    m_swept_maxs.resize(N);
+    float longest_edges = 0.f;
+    for (const glm::uvec3 &t : m_triangles) {
+        glm::vec3 p0 = position(t[0]), p1 = position(t[1]), p2 = position(t[2]);
+        longest_edges += std::max(std::max(glm::distance(p0, p1), glm::distance(p1, p2)), glm::distance(p2, p0));
+    }
+    m_collision_cell_size = m_triangles.empty() ? 0.f : longest_edges / m_triangles.size();
+
+    if (m_solver_settings.mode == COLORED_GAUSS_SEIDEL && m_coloring_dirty)
+        computeColoring();
+    if (m_solver_settings.mode == JACOBI && m_adjacency_dirty)
+        computeAdjacency();
+
+    m_workspace_dirty = false;
+}
+
+void DynamicObject::computeColoring() {
+    m_distance_constraints.permute(m_distance_constraints.computeColoring(N));
+    m_bending_constraints.permute(m_bending_constraints.computeColoring(N));
+    m_volume_constraints.permute(m_volume_constraints.computeColoring(N));
+    m_attachment_constraints.permute(m_attachment_constraints.computeColoring(N));
+    m_coloring_dirty = false;
+    m_adjacency_dirty = true; // the slots follow the order of the constraints
+}
+
+template <class Batch>
+ProjectionResult DynamicObject::projectBatch(Batch &_batch, float _inv_dt2, std::vector<glm::vec3> &_new_positions) {
+    glm::vec3 *p = _new_positions.data();
+    const float *w = m_weights.data();
+    ProjectionResult result;
+
+    if (m_solver_settings.mode == GAUSS_SEIDEL || _batch.colorCount() == 0) {
+        for (uint ci = 0; ci < _batch.size(); ci++)
+            result.add(projectConstraint(_batch, ci, p, w, _inv_dt2));
+        return result;
+    }
+
+    // COLORED_GAUSS_SEIDEL: constraints of a same color share no vertex, so they can be projected concurrently
+    const uint grain = CONSTRAINT_GRAIN;
+    for (uint c = 0; c < _batch.colorCount(); c++) {
+        uint begin = _batch.color_offsets[c], end = _batch.color_offsets[c + 1];
+        uint chunk_count = ThreadPool::chunkCount(begin, end, grain);
+        ProjectionResult *chunk_results = m_chunk_results.data();
+        m_thread_pool->parallelForChunks(begin, end, grain, [&](uint _chunk, uint _begin, uint _end) {
+            ProjectionResult chunk_result;
+            for (uint ci = _begin; ci < _end; ci++)
+                chunk_result.add(projectConstraint(_batch, ci, p, w, _inv_dt2));
+            chunk_results[_chunk] = chunk_result;
+        });
+        for (uint chunk = 0; chunk < chunk_count; chunk++)
+            result.add(chunk_results[chunk]);
+    }
+    return result;
+}
+
+ProjectionResult DynamicObject::projectGenericConstraint(uint _ci, std::vector<glm::vec3> &_new_positions) {
+    // gather function input (and total weight)
+    m_affected_points.resize(m_cardinalities[_ci]);
+    float total_weigths = 0.f;
+    for (uint i = 0; i < m_cardinalities[_ci]; i++) {
+        uint pj = m_indices[_ci][i];
+        m_affected_points[i] = _new_positions[pj];
+        total_weigths += m_weights[pj];
+    }
+
+    ProjectionResult result;
+    float function_value = m_functions[_ci](m_affected_points);
+    if (m_types[_ci] == INEQUALITY_CONSTRAINT && function_value >= 0.f) {
+        // The constraint is already satisfied so we don't project it
+        return result;
+    }
+    result.residual = fabsf(function_value);
+
+    // Determine S
+    m_affected_gradients.resize(m_cardinalities[_ci]);
+    float denominator = 0.f;
+    for (uint i = 0; i < m_cardinalities[_ci]; i++) {
+        m_affected_gradients[i] = m_gradients[_ci](m_affected_points, i);
+        denominator += length2(m_affected_gradients[i]);
+    }
+    float s = function_value / denominator;
+
+    // add the deltas
+    float constraint_evolution = 0.f;
+    for (uint i = 0; i < m_cardinalities[_ci]; i++) {
+        uint pj = m_indices[_ci][i];
+        glm::vec3 delta_pj = -s * (float(m_cardinalities[_ci]) * m_weights[pj] / total_weigths) * m_affected_gradients[i];
+        _new_positions[pj] += m_stiffnesses[_ci] * delta_pj;
+        constraint_evolution += glm::length(delta_pj);
+    }
+    result.evolution = constraint_evolution / m_cardinalities[_ci];
+    return result;
+}
+
+template <class Batch>
+void DynamicObject::appendSlots(const Batch &_batch, uint &_slot, bool _count) {
+    for (uint ci = 0; ci < _batch.size(); ci++) {
+        for (uint i = 0; i < Batch::cardinality; i++, _slot++) {
+            uint pj = _batch.indices[ci][i];
+            if (_count)
+                m_vertex_slot_offsets[pj + 1]++;
+            else
+                m_vertex_slots[m_vertex_slot_offsets[pj]++] = _slot;
+        }
+    }
+}
+
+void DynamicObject::computeAdjacency() {
+    // count the slots of every vertex, then fill them (the offsets are shifted back afterwards)
+    m_vertex_slot_offsets.assign(N + 1, 0);
+    uint slot_count = 0;
+    appendSlots(m_distance_constraints, slot_count, true);
+    appendSlots(m_bending_constraints, slot_count, true);
+    appendSlots(m_volume_constraints, slot_count, true);
+    appendSlots(m_attachment_constraints, slot_count, true);
+    for (uint i = 0; i < N; i++)
+        m_vertex_slot_offsets[i + 1] += m_vertex_slot_offsets[i];
+
+    m_vertex_slots.resize(slot_count);
+    m_slot_deltas.resize(slot_count);
+    uint slot = 0;
+    appendSlots(m_distance_constraints, slot, false);
+    appendSlots(m_bending_constraints, slot, false);
+    appendSlots(m_volume_constraints, slot, false);
+    appendSlots(m_attachment_constraints, slot, false);
+    for (uint i = N; i > 0; i--)
+        m_vertex_slot_offsets[i] = m_vertex_slot_offsets[i - 1];
+    m_vertex_slot_offsets[0] = 0;
+
+    m_adjacency_dirty = false;
+}
+
+template <class Batch>
+ProjectionResult DynamicObject::computeBatchDeltas(Batch &_batch, uint _first_slot, float _inv_dt2, const std::vector<glm::vec3> &_new_positions) {
+    const glm::vec3 *p = _new_positions.data();
+    const float *w = m_weights.data();
+    glm::vec3 *deltas = m_slot_deltas.data() + _first_slot;
+
+    const uint grain = CONSTRAINT_GRAIN;
+    uint chunk_count = ThreadPool::chunkCount(0, _batch.size(), grain);
+    ProjectionResult *chunk_results = m_chunk_results.data();
+    m_thread_pool->parallelForChunks(0, _batch.size(), grain, [&](uint _chunk, uint _begin, uint _end) {
+        ProjectionResult chunk_result;
+        for (uint ci = _begin; ci < _end; ci++)
+            chunk_result.add(computeConstraintDeltas(_batch, ci, p, w, _inv_dt2, deltas + ci * Batch::cardinality));
+        chunk_results[_chunk] = chunk_result;
+    });
+
+    ProjectionResult result;
+    for (uint chunk = 0; chunk < chunk_count; chunk++)
+        result.add(chunk_results[chunk]);
+    return result;
+}
+
+/*
+Jacobi iteration with Chebyshev semi-iterative acceleration
+READ "A Chebyshev Semi-Iterative Approach for Accelerating Projective and Position-based Dynamics" (Wang 2015)
+(1) forall constraints j do compute ∆pi (j) from q(k)              (no write, order independent)
+(2) forall vertices i do q̂i = qi(k) + ω ∑j ∆pi (j) / ni             (ni: number of active constraints on i)
+(3) ωk = 1 if k < S, 2 / (2 - ρ²) if k = S, 4 / (4 - ρ² ωk-1) otherwise
+(4) q(k+1) = ωk (q̂ - q(k-1)) + q(k-1)
+*/
+void DynamicObject::jacobiIteration(uint _iteration, float &_chebyshev_omega, float _inv_dt2, std::vector<glm::vec3> &_new_positions, ProjectionResult *_results) {
+    // (1)
+    uint slot = 0;
+    _results[DISTANCE_CONSTRAINTS] = computeBatchDeltas(m_distance_constraints, slot, _inv_dt2, _new_positions);
+    slot += m_distance_constraints.size() * DistanceConstraints::cardinality;
+    _results[BENDING_CONSTRAINTS] = computeBatchDeltas(m_bending_constraints, slot, _inv_dt2, _new_positions);
+    slot += m_bending_constraints.size() * BendingConstraints::cardinality;
+    _results[VOLUME_CONSTRAINTS] = computeBatchDeltas(m_volume_constraints, slot, _inv_dt2, _new_positions);
+    slot += m_volume_constraints.size() * VolumeConstraints::cardinality;
+    _results[ATTACHMENT_CONSTRAINTS] = computeBatchDeltas(m_attachment_constraints, slot, _inv_dt2, _new_positions);
+
+    // (3)
+    const SolverSettings &settings = m_solver_settings;
+    float rho2 = settings.chebyshev_rho * settings.chebyshev_rho;
+    if (settings.chebyshev_rho <= 0.f || _iteration < settings.chebyshev_delay)
+        _chebyshev_omega = 1.f;
+    else if (_iteration == settings.chebyshev_delay)
+        _chebyshev_omega = 2.f / (2.f - rho2);
+    else
+        _chebyshev_omega = 4.f / (4.f - rho2 * _chebyshev_omega);
+    if (_iteration == 0)
+        std::copy(_new_positions.begin(), _new_positions.begin() + N, m_previous_positions.begin()); // the predicted positions are padded
+
+    // (2) and (4): gather the slots of every vertex, no two threads write the same vertex
+    glm::vec3 *p = _new_positions.data();
+    glm::vec3 *previous = m_previous_positions.data();
+    const glm::vec3 *deltas = m_slot_deltas.data();
+    const uint *offsets = m_vertex_slot_offsets.data();
+    const uint *slots = m_vertex_slots.data();
+    float omega = settings.jacobi_relaxation, chebyshev_omega = _chebyshev_omega;
+    m_thread_pool->parallelFor(0, N, 1024, [&](uint i) {
+        glm::vec3 sum = glm::vec3(0.f);
+        uint active = 0;
+        for (uint s = offsets[i]; s < offsets[i + 1]; s++) {
+            const glm::vec3 &delta = deltas[slots[s]];
+            sum += delta;
+            active += delta != glm::vec3(0.f);
+        }
+        glm::vec3 q = p[i];
+        glm::vec3 q_hat = active > 0 ? q + (omega / active) * sum : q;
+        p[i] = chebyshev_omega * (q_hat - previous[i]) + previous[i];
+        previous[i] = q;
+    });
+}
+
+/*
+READ "Meshless Deformations Based on Shape Matching" (Müller 2005), see ShapeMatchingClusters.
+(1) forall clusters (in parallel, by chunks of CLUSTER_GRAIN) do
+        c = ∑i mi pi / ∑i mi, Apq = ∑i mi (pi - c) qiT
+        R = rotational part of Apq (SIMD over the clusters of the chunk)
+        forall vertices i of the cluster do ∆pi = k (R qi + c - pi)
+    The fixed vertices f of a cluster anchor it: the motion is fitted around them instead of the center of mass,
+    i.e. c = mean of pf and qi is replaced by qi - mean of qf (a cluster pinned by a corner swings around it).
+(2) forall vertices i (in parallel) do pi ← pi + ∑ ∆pi / ni (ni: number of clusters of i, fixed vertices do not move)
+The clusters overlap, so their corrections are averaged (Jacobi) whatever the solver mode.
+*/
+ProjectionResult DynamicObject::projectShapeMatching(std::vector<glm::vec3> &_new_positions) {
+    ShapeMatchingClusters &clusters = m_shape_matching;
+    if (clusters.size() == 0)
+        return ProjectionResult();
+    glm::vec3 *p = _new_positions.data();
+    const float *masses = m_masses.data(), *w = m_weights.data();
+    const uint rotation_iterations = m_solver_settings.rotation_iterations;
+
+    // (1)
+    const uint chunk_count = ThreadPool::chunkCount(0, clusters.size(), CLUSTER_GRAIN);
+    ProjectionResult *chunk_results = m_chunk_results.data();
+    m_thread_pool->parallelForChunks(0, clusters.size(), CLUSTER_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        for (uint c = _begin; c < _end; c++) {
+            glm::vec3 center = glm::vec3(0.f), anchor = glm::vec3(0.f), rest_anchor = glm::vec3(0.f);
+            uint anchor_count = 0;
+            for (uint pair = clusters.offsets[c]; pair < clusters.offsets[c + 1]; pair++) {
+                uint i = clusters.indices[pair];
+                center += masses[i] * p[i];
+                if (w[i] == 0.f) {
+                    anchor += p[i];
+                    rest_anchor += clusters.rest_offsets[pair];
+                    anchor_count++;
+                }
+            }
+            if (anchor_count > 0) {
+                center = anchor / float(anchor_count);
+                rest_anchor /= float(anchor_count);
+            } else {
+                center /= std::max(clusters.masses[c], 1e-12f);
+            }
+            glm::mat3 apq = glm::mat3(0.f);
+            for (uint pair = clusters.offsets[c]; pair < clusters.offsets[c + 1]; pair++) {
+                uint i = clusters.indices[pair];
+                apq += glm::outerProduct(masses[i] * (p[i] - center), clusters.rest_offsets[pair] - rest_anchor);
+            }
+            clusters.centers[c] = center;
+            clusters.rest_anchors[c] = rest_anchor;
+            clusters.matrices.set(c, apq);
+        }
+
+        MatrixKernels::extractRotations(clusters.matrices, clusters.rotations, rotation_iterations, _begin, _end);
+
+        ProjectionResult chunk_result;
+        for (uint c = _begin; c < _end; c++) {
+            glm::mat3 rotation = clusters.matrices.get(c);
+            glm::vec3 center = clusters.centers[c] - rotation * clusters.rest_anchors[c];
+            float displacement = 0.f;
+            for (uint pair = clusters.offsets[c]; pair < clusters.offsets[c + 1]; pair++) {
+                uint i = clusters.indices[pair];
+                glm::vec3 offset = rotation * clusters.rest_offsets[pair] + center - p[i];
+                float distance = w[i] > 0.f ? glm::length(offset) : 0.f;
+                clusters.deltas[pair] = clusters.stiffnesses[c] * offset;
+                chunk_result.residual = std::max(chunk_result.residual, distance);
+                displacement += clusters.stiffnesses[c] * distance;
+            }
+            chunk_result.evolution += displacement / std::max(clusters.offsets[c + 1] - clusters.offsets[c], 1u);
+        }
+        chunk_results[_chunk] = chunk_result;
+    });
+    ProjectionResult result;
+    for (uint chunk = 0; chunk < chunk_count; chunk++)
+        result.add(chunk_results[chunk]);
+
+    // (2)
+    const uint *offsets = clusters.vertex_offsets.data(), *pairs = clusters.vertex_pairs.data();
+    const glm::vec3 *deltas = clusters.deltas.data();
+    m_thread_pool->parallelFor(0, N, 1024, [&](uint i) {
+        if (w[i] == 0.f || offsets[i] == offsets[i + 1])
+            return;
+        glm::vec3 sum = glm::vec3(0.f);
+        for (uint k = offsets[i]; k < offsets[i + 1]; k++)
+            sum += deltas[pairs[k]];
+        p[i] += sum / float(offsets[i + 1] - offsets[i]);
+    });
+    return result;
+}
+
+void DynamicObject::projectConstraints(uint _iteration, float &_chebyshev_omega, float _inv_dt2, std::vector<glm::vec3> &_new_positions, ProjectionResult *_results) {
+    if (m_solver_settings.mode == JACOBI) {
+        jacobiIteration(_iteration, _chebyshev_omega, _inv_dt2, _new_positions, _results);
+    } else {
+        _results[DISTANCE_CONSTRAINTS] = projectBatch(m_distance_constraints, _inv_dt2, _new_positions);
+        _results[BENDING_CONSTRAINTS] = projectBatch(m_bending_constraints, _inv_dt2, _new_positions);
+        _results[VOLUME_CONSTRAINTS] = projectBatch(m_volume_constraints, _inv_dt2, _new_positions);
+        _results[ATTACHMENT_CONSTRAINTS] = projectBatch(m_attachment_constraints, _inv_dt2, _new_positions);
+    }
+    _results[SHAPE_MATCHING_CONSTRAINTS] = projectShapeMatching(_new_positions);
+    // collision and generic constraints are always projected in place
+    _results[COLLISION_CONSTRAINTS] = projectCollisionConstraints(_inv_dt2, _new_positions);
+    _results[GENERIC_CONSTRAINTS] = ProjectionResult();
+    for (uint ci = 0; ci < m_functions.size(); ci++)
+        _results[GENERIC_CONSTRAINTS].add(projectGenericConstraint(ci, _new_positions));
+}
+
+/*
+Continuous collision detection, the vertices move linearly from xi (t = 0) to pi (t = 1) during the step.
+Times at which a vertex q and a triangle (p1, p2, p3) moving linearly are coplanar (READ "Collision detection for
+cloth modeling", Provot 1997): roots in [0; 1] of the cubic f(t) = (q - p1)(t) . ((p2 - p1)(t) x (p3 - p1)(t)).
+f is split in monotonic intervals at the roots of f', the intervals where f changes its sign are bisected.
+Returns the number of roots, stored in increasing order in _times.
+*/
+static uint coplanarityTimes(const glm::vec3 &_q0, const glm::vec3 &_dq, const glm::vec3 &_e10, const glm::vec3 &_de1,
+                             const glm::vec3 &_e20, const glm::vec3 &_de2, float _times[3]) {
+    glm::vec3 n0 = glm::cross(_e10, _e20), n1 = glm::cross(_e10, _de2) + glm::cross(_de1, _e20), n2 = glm::cross(_de1, _de2);
+    const float d = glm::dot(_q0, n0), c = glm::dot(_dq, n0) + glm::dot(_q0, n1), b = glm::dot(_dq, n1) + glm::dot(_q0, n2), a = glm::dot(_dq, n2);
+    auto f = [&](float _t) { return ((a * _t + b) * _t + c) * _t + d; };
+
+    // bounds of the monotonic intervals
+    float bounds[4] = {0.f, 1.f, 1.f, 1.f};
+    uint bound_count = 1;
+    float qa = 3.f * a, qb = 2.f * b, qc = c; // f'
+    float extrema[2];
+    uint extremum_count = 0;
+    if (fabsf(qa) > 1e-20f) {
+        float discriminant = qb * qb - 4.f * qa * qc;
+        if (discriminant > 0.f) {
+            float root = sqrtf(discriminant);
+            extrema[0] = (-qb - root) / (2.f * qa);
+            extrema[1] = (-qb + root) / (2.f * qa);
+            if (extrema[0] > extrema[1])
+                std::swap(extrema[0], extrema[1]);
+            extremum_count = 2;
+        }
+    } else if (fabsf(qb) > 1e-20f) {
+        extrema[0] = -qc / qb;
+        extremum_count = 1;
+    }
+    for (uint k = 0; k < extremum_count; k++)
+        if (extrema[k] > 0.f && extrema[k] < 1.f)
+            bounds[bound_count++] = extrema[k];
+    bounds[bound_count++] = 1.f;
+
+    uint count = 0;
+    for (uint k = 0; k + 1 < bound_count; k++) {
+        float lo = bounds[k], hi = bounds[k + 1], f_lo = f(lo), f_hi = f(hi);
+        if (f_lo == 0.f) {
+            if (count == 0 || _times[count - 1] < lo)
+                _times[count++] = lo;
+            continue;
+        }
+        if ((f_lo < 0.f) == (f_hi < 0.f) && f_hi != 0.f)
             continue;
-        glm::vec3 ri = m_positions[i] - xcm;
-        glm::vec3 dvi = vcm + glm::cross(omega, ri) - m_velocities[i]; // (7)
-        m_velocities[i] += k_damping * dvi;                            // (8)
+        for (uint iteration = 0; iteration < 32; iteration++) {
+            float mid = 0.5f * (lo + hi), f_mid = f(mid);
+            if ((f_mid < 0.f) == (f_lo < 0.f) && f_mid != 0.f) {
+                lo = mid;
+                f_lo = f_mid;
+            } else {
+                hi = mid;
+            }
+        }
+        _times[count++] = hi;
     }
+    return count;
+}
+
+// Barycentric coordinates of the projection of _q on the plane of the triangle (_p1, _p2, _p3), false if degenerated
+static bool barycentricCoordinates(const glm::vec3 &_q, const glm::vec3 &_p1, const glm::vec3 &_p2, const glm::vec3 &_p3, glm::vec3 &_barycentric) {
+    glm::vec3 e1 = _p2 - _p1, e2 = _p3 - _p1, e = _q - _p1;
+    float d11 = glm::dot(e1, e1), d12 = glm::dot(e1, e2), d22 = glm::dot(e2, e2);
+    float determinant = d11 * d22 - d12 * d12;
+    if (determinant < 1e-12f)
+        return false;
+    float d1 = glm::dot(e, e1), d2 = glm::dot(e, e2);
+    _barycentric.y = (d22 * d1 - d12 * d2) / determinant;
+    _barycentric.z = (d11 * d2 - d12 * d1) / determinant;
+    _barycentric.x = 1.f - _barycentric.y - _barycentric.z;
+    return true;
+}
+
+/*
+(8) Collisions
+Self collisions, broad phase: the swept box of every vertex (box of xi and pi) is hashed in cells of size
+max(h, mean longest edge of the triangles, largest swept box / 4), so that a fast vertex overlaps a few cells only.
+Narrow phase, in parallel, every chunk writing its own output (concatenated in chunk order, so the constraints
+do not depend on the number of threads):
+- particle-particle: the vertices whose swept box overlaps the swept box of i grown by h, with a time of impact
+  in [0; 1] (see ParticleContactConstraints::timeOfImpact) -> C = (pi - pj) . n - h >= 0 with n the direction from j to i at the impact
+- vertex-triangle ("4.4 Cloth Self Collision" of ./articles/Position_Based_Dynamics.pdf): the vertices whose swept box
+  overlaps the swept box of the triangle grown by h. The vertex went through the triangle during the step if they are
+  coplanar at a time t (see coplanarityTimes) at which the vertex is inside the triangle: the barycentric coordinates
+  of the first such impact are used. Otherwise, the vertex is in contact if it projects inside the triangle at the end
+  of the step, closer than h to its plane on the side it came from (measured on xi) -> C = σ (q - ∑k bk pk) . n - h >= 0
+  The constraints are built at the time of impact, so a large step cannot let a vertex tunnel through the surface.
+Static colliders: the BVH of every collider is queried in parallel for the segment xi -> pi of every free vertex
+-> C = (pi - q) . n - h >= 0 with the plane (q, n) of the first triangle crossed, or the closest one (see StaticBVH::collide)
+*/
+size_t DynamicObject::collisionCapacity() const {
+    size_t capacity = m_particle_contacts.capacity() + m_triangle_contacts.capacity() + m_spatial_hash.capacity();
+    for (const std::vector<ParticleContact> &contacts : m_chunk_particle_contacts)
+        capacity += contacts.capacity();
+    for (const std::vector<TriangleContact> &contacts : m_chunk_triangle_contacts)
+        capacity += contacts.capacity();
+    return capacity;
+}
+
+void DynamicObject::generateCollisionConstraints(const std::vector<glm::vec3> &_new_positions) {
+    m_particle_contacts.clear();
+    m_triangle_contacts.clear();
+    m_static_contacts.clear();
+    m_solver_stats.contacts = 0;
+    if (N == 0)
+        return;
+
+    const float h = m_solver_settings.collision_thickness, stiffness = m_solver_settings.collision_stiffness;
+    const glm::vec3 *p = _new_positions.data();
+    const float *w = m_weights.data();
+    m_particle_contacts.thickness = m_triangle_contacts.thickness = m_static_contacts.thickness = h;
+
+    for (const StaticBVH *collider : m_colliders) {
+        m_thread_pool->parallelForChunks(0, N, COLLISION_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+            std::vector<StaticContact> &contacts = m_chunk_static_contacts[_chunk];
+            contacts.clear();
+            StaticContact contact;
+            for (uint i = _begin; i < _end; i++) {
+                contact.vertex = i;
+                if (w[i] > 0.f && collider->collide(position(i), p[i], h, contact.point, contact.normal))
+                    contacts.push_back(contact);
+            }
+        });
+        for (const std::vector<StaticContact> &contacts : m_chunk_static_contacts) {
+            for (const StaticContact &contact : contacts) {
+                m_static_contacts.add({contact.vertex}, stiffness, 0.f);
+                m_static_contacts.points.push_back(contact.point);
+                m_static_contacts.normals.push_back(contact.normal);
+            }
+        }
+    }
+    m_solver_stats.contacts = m_static_contacts.size();
+
+    if (!m_solver_settings.self_collisions)
+        return;
+
+    // swept boxes
+    glm::vec3 *swept_mins = m_swept_mins.data(), *swept_maxs = m_swept_maxs.data();
+    float *chunk_sweeps = m_chunk_sweeps.data();
+    m_thread_pool->parallelForChunks(0, N, COLLISION_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        float sweep = 0.f;
+        for (uint i = _begin; i < _end; i++) {
+            glm::vec3 x = position(i);
+            swept_mins[i] = glm::min(x, p[i]);
+            swept_maxs[i] = glm::max(x, p[i]);
+            glm::vec3 extent = swept_maxs[i] - swept_mins[i];
+            sweep = std::max(sweep, std::max(std::max(extent.x, extent.y), extent.z));
+        }
+        chunk_sweeps[_chunk] = sweep;
+    });
+    float largest_sweep = *std::max_element(m_chunk_sweeps.begin(), m_chunk_sweeps.end());
+    m_spatial_hash.build(swept_mins, swept_maxs, N, std::max(std::max(h, m_collision_cell_size), 0.25f * largest_sweep), *m_thread_pool);
+
+    // particle-particle
+    m_thread_pool->parallelForChunks(0, N, COLLISION_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        std::vector<ParticleContact> &contacts = m_chunk_particle_contacts[_chunk];
+        contacts.clear();
+        for (uint i = _begin; i < _end; i++) {
+            glm::vec3 x = position(i);
+            m_spatial_hash.forEachInBox(swept_mins[i] - h, swept_maxs[i] + h, [&](uint _j) {
+                if (_j <= i || (w[i] == 0.f && w[_j] == 0.f))
+                    return;
+                glm::vec3 d0 = x - position(_j), d1 = p[i] - p[_j];
+                float t;
+                if (!ParticleContactConstraints::timeOfImpact(d0, d1, h, t))
+                    return;
+                glm::vec3 d = d0 + t * (d1 - d0);
+                float length = glm::length(d);
+                if (length > 1e-12f)
+                    contacts.push_back({{i, _j}, d / length});
+            });
+        }
+    });
+
+    // vertex-triangle
+    m_thread_pool->parallelForChunks(0, m_triangles.size(), COLLISION_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        std::vector<TriangleContact> &contacts = m_chunk_triangle_contacts[_chunk];
+        contacts.clear();
+        for (uint t = _begin; t < _end; t++) {
+            const glm::uvec3 &triangle = m_triangles[t];
+            const glm::vec3 &p1 = p[triangle[0]], &p2 = p[triangle[1]], &p3 = p[triangle[2]];
+            glm::vec3 normal = glm::cross(p2 - p1, p3 - p1);
+            if (glm::dot(normal, normal) < 1e-12f)
+                continue; // degenerated triangle
+            normal = glm::normalize(normal);
+            bool fixed_triangle = w[triangle[0]] == 0.f && w[triangle[1]] == 0.f && w[triangle[2]] == 0.f;
+            glm::vec3 x1 = position(triangle[0]), x2 = position(triangle[1]), x3 = position(triangle[2]);
+            glm::vec3 previous_normal = glm::cross(x2 - x1, x3 - x1);
+
+            glm::vec3 box_min = glm::min(glm::min(swept_mins[triangle[0]], swept_mins[triangle[1]]), swept_mins[triangle[2]]) - h;
+            glm::vec3 box_max = glm::max(glm::max(swept_maxs[triangle[0]], swept_maxs[triangle[1]]), swept_maxs[triangle[2]]) + h;
+            m_spatial_hash.forEachInBox(box_min, box_max, [&](uint _q) {
+                if (_q == triangle[0] || _q == triangle[1] || _q == triangle[2] || (fixed_triangle && w[_q] == 0.f))
+                    return;
+                // σ: side of q at the start of the step
+                glm::vec3 xq = position(_q);
+                float side = glm::dot(xq - x1, previous_normal) >= 0.f ? 1.f : -1.f;
+
+                // went through the triangle: first coplanarity time at which q is inside
+                glm::vec3 barycentric;
+                float times[3];
+                uint time_count = coplanarityTimes(xq - x1, (p[_q] - xq) - (p1 - x1), x2 - x1, (p2 - x2) - (p1 - x1), x3 - x1, (p3 - x3) - (p1 - x1), times);
+                for (uint k = 0; k < time_count; k++) {
+                    float s = times[k];
+                    if (barycentricCoordinates(glm::mix(xq, p[_q], s), glm::mix(x1, p1, s), glm::mix(x2, p2, s), glm::mix(x3, p3, s), barycentric) &&
+                        barycentric.x >= -1e-3f && barycentric.y >= -1e-3f && barycentric.z >= -1e-3f) {
+                        barycentric = glm::max(barycentric, glm::vec3(0.f));
+                        barycentric /= barycentric.x + barycentric.y + barycentric.z;
+                        contacts.push_back({{_q, triangle[0], triangle[1], triangle[2]}, barycentric, side});
+                        return;
+                    }
+                }
+
+                // close to the triangle at the end of the step
+                if (!barycentricCoordinates(p[_q], p1, p2, p3, barycentric) || barycentric.x < 0.f || barycentric.y < 0.f || barycentric.z < 0.f)
+                    return;
+                if (side * glm::dot(p[_q] - p1, normal) < h)
+                    contacts.push_back({{_q, triangle[0], triangle[1], triangle[2]}, barycentric, side});
+            });
+        }
+    });
+
+    // concatenation in chunk order
+    for (const std::vector<ParticleContact> &contacts : m_chunk_particle_contacts) {
+        for (const ParticleContact &contact : contacts) {
+            m_particle_contacts.add(contact.indices, stiffness, 0.f);
+            m_particle_contacts.normals.push_back(contact.normal);
+        }
+    }
+    for (const std::vector<TriangleContact> &contacts : m_chunk_triangle_contacts) {
+        for (const TriangleContact &contact : contacts) {
+            m_triangle_contacts.add(contact.indices, stiffness, 0.f);
+            m_triangle_contacts.barycentrics.push_back(contact.barycentric);
+            m_triangle_contacts.sides.push_back(contact.side);
+        }
+    }
+    m_solver_stats.contacts += m_particle_contacts.size() + m_triangle_contacts.size();
+}
+
+ProjectionResult DynamicObject::projectCollisionConstraints(float _inv_dt2, std::vector<glm::vec3> &_new_positions) {
+    glm::vec3 *p = _new_positions.data();
+    const float *w = m_weights.data();
+    ProjectionResult result;
+    for (uint ci = 0; ci < m_static_contacts.size(); ci++)
+        result.add(projectConstraint(m_static_contacts, ci, p, w, _inv_dt2));
+    for (uint ci = 0; ci < m_particle_contacts.size(); ci++)
+        result.add(projectConstraint(m_particle_contacts, ci, p, w, _inv_dt2));
+    for (uint ci = 0; ci < m_triangle_contacts.size(); ci++)
+        result.add(projectConstraint(m_triangle_contacts, ci, p, w, _inv_dt2));
+    return result;
 }
 
 /*
@@ -86,86 +718,196 @@ READ "3.1. Algorithm Overview" of ./articles/Position_Based_Dynamics.pdf
 (15)      endfor
 (16)      velocityUpdate(v1 ,..., vN )
 (17)  endloop
+
+With XPBD ("Algorithm 1" of ./articles/Extended_Position_Based_Dynamics.pdf), the frame is split in
+substeps which run (5)-(16) with ∆t / substeps, λ is reset before (9) and (9)-(11) runs a fixed number of times.
+A sleeping object is skipped (see updateResting). An update which neither reserved the workspace nor grew the self
+collision buffers is steady: it makes no heap allocation (asserted in DEBUG builds).
 */
-void DynamicObject::update(float _delta_time) {
-    std::vector<glm::vec3> new_positions(N); // p_i
+const SolverStats &DynamicObject::update(float _delta_time) {
+    const SolverSettings &settings = m_solver_settings;
+    uint substeps = settings.use_xpbd ? std::max(1u, settings.substeps) : 1;
+    float delta_time = _delta_time / substeps;
+
+    m_solver_stats = SolverStats();
+    if (m_sleeping) {
+        m_solver_stats.sleeping = true;
+        return m_solver_stats;
+    }
+    PROFILE_SCOPE("DynamicObject::update");
+    m_step_start = std::chrono::steady_clock::now();
+    const SolverMode mode = settings.mode;
+    const bool reserved = !m_workspace_dirty && !(mode == COLORED_GAUSS_SEIDEL && m_coloring_dirty) && !(mode == JACOBI && m_adjacency_dirty);
+    const size_t collision_capacity = collisionCapacity();
+    size_t heap_allocations = threadHeapAllocationCount();
+    for (uint substep = 0; substep < substeps; substep++)
+        step(delta_time);
+    m_rendered_positions_dirty = true;
+    if (m_sleeps_alone && updateResting())
+        sleep();
+    m_solver_stats.heap_allocations = threadHeapAllocationCount() - heap_allocations;
+    m_solver_stats.steady = reserved && collisionCapacity() == collision_capacity;
+#ifdef DEBUG
+    assert(!m_solver_stats.steady || m_solver_stats.heap_allocations == 0);
+#endif
+    return m_solver_stats;
+}
+
+/*
+Sleeping ("deactivation"): the object rests while its kinetic energy per unit mass ½ ∑ mi vi² / ∑ mi (free vertices)
+stays below sleep_energy, it sleeps after sleep_frames resting updates. The energy is reduced by chunks of vertices
+combined in their order, so the object falls asleep at the same update for any number of threads.
+*/
+bool DynamicObject::updateResting() {
+    const SolverSettings &settings = m_solver_settings;
+    if (settings.sleep_frames == 0 || N == 0)
+        return false;
+
+    const float *vx = m_velocities.x.data(), *vy = m_velocities.y.data(), *vz = m_velocities.z.data();
+    const float *masses = m_masses.data(), *weights = m_weights.data();
+    glm::vec2 *chunk_energies = m_chunk_energies.data();
+    m_thread_pool->parallelForChunks(0, N, VERTEX_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        glm::vec2 energy(0.f);
+        for (uint i = _begin; i < _end; i++) {
+            float mi = weights[i] > 0.f ? masses[i] : 0.f; // fixed vertices are ignored
+            energy.x += mi;
+            energy.y += 0.5f * mi * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+        }
+        chunk_energies[_chunk] = energy;
+    });
+    glm::vec2 total(0.f);
+    for (uint chunk = 0; chunk < ThreadPool::chunkCount(0, N, VERTEX_GRAIN); chunk++)
+        total += chunk_energies[chunk];
+
+    bool resting = total.x == 0.f || total.y <= settings.sleep_energy * total.x;
+    m_resting_frames = resting ? m_resting_frames + 1 : 0;
+    return isResting();
+}
+
+void DynamicObject::sleep() {
+    std::fill(m_velocities.x.begin(), m_velocities.x.end(), 0.f);
+    std::fill(m_velocities.y.begin(), m_velocities.y.end(), 0.f);
+    std::fill(m_velocities.z.begin(), m_velocities.z.end(), 0.f);
+    sweptBounds(0.f, m_sleeping_min, m_sleeping_max);
+    m_sleeping = true;
+}
+
+/*
+Stopping policy of (9)-(11), checked after every iteration:
+- converged: the residual of every constraint family is below its tolerance
+- XPBD: exactly xpbd_iterations iterations per substep
+- PBD: the evolution stagnates (|∆evolution| <= stagnation_tolerance) or max_iterations is reached
+- the time budget of the whole update() is exhausted
+*/
+bool DynamicObject::stopIterating(uint _iteration, float _old_evolution, float _evolution, const ProjectionResult *_results) {
+    const SolverSettings &settings = m_solver_settings;
+
+    m_solver_stats.converged = true;
+    for (uint family = 0; family < CONSTRAINT_FAMILY_COUNT; family++) {
+        m_solver_stats.residuals[family] = _results[family].residual;
+        m_solver_stats.converged &= _results[family].residual <= settings.tolerances[family];
+    }
+    if (m_solver_stats.converged)
+        return true;
+
+    if (settings.use_xpbd) {
+        if (_iteration >= settings.xpbd_iterations)
+            return true;
+    } else {
+        if (fabsf(_old_evolution - _evolution) <= settings.stagnation_tolerance || _iteration >= settings.max_iterations)
+            return true;
+    }
+
+    if (settings.time_budget > 0.f) {
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - m_step_start;
+        if (elapsed.count() >= settings.time_budget) {
+            m_solver_stats.out_of_time = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DynamicObject::step(float _delta_time) {
+    const SolverMode mode = m_solver_settings.mode;
+    if (m_workspace_dirty || (mode == COLORED_GAUSS_SEIDEL && m_coloring_dirty) || (mode == JACOBI && m_adjacency_dirty))
+        reserveWorkspace(); // only after vertices or constraints were added (or the solver mode changed)
+    std::vector<glm::vec3> &new_positions = m_new_positions; // p_i
+    std::chrono::steady_clock::time_point phase_start = std::chrono::steady_clock::now();
+
+    const uint padded_N = m_positions.paddedSize();
 
     // (5) external forces (gravity, etc...) (for now, just gravity)
-    for (uint i = 0; i < N; i++)
-        m_velocities[i] = m_fixed[i] ? m_velocities[i] : m_velocities[i] + _delta_time * glm::vec3(0., -9.807f, 0.f);
+    {
+        PROFILE_SCOPE("(5) external forces");
+        m_thread_pool->parallelForChunks(0, padded_N, VERTEX_GRAIN, [&](uint, uint _begin, uint _end) {
+            VertexKernels::applyAcceleration(m_velocities, m_weights.data(), GRAVITY, _delta_time, _begin, _end);
+        });
+    }
 
     // (6)
-    dampVelocities(1.f);
+    {
+        PROFILE_SCOPE("(6) damping");
+        dampVelocities(1.f);
+    }
 
     // (7)
-    for (uint i = 0; i < N; i++)
-        new_positions[i] = m_fixed[i] ? m_positions[i] : m_positions[i] + _delta_time * m_velocities[i];
-
-    // TODO: (8) Generate collision constraints
-
-    // (9)-(11)
-    std::vector<glm::vec3> affected_points;
-    std::vector<glm::vec3> gradients;
-    float old_evolution, evolution, constraint_evolution;
-    old_evolution = evolution = constraint_evolution = 0.f;
-    do { // TODO: while pas convergé
-        old_evolution = evolution;
-        evolution = 0.f;
-        for (uint ci = 0; ci < M; ci++) {
-            constraint_evolution = 0.f;
-
-            // gather function input (and total weight)
-            affected_points.resize(m_cardinalities[ci]);
-            float total_weigths = 0.f;
-            for (uint i = 0; i < m_cardinalities[ci]; i++) {
-                uint pj = m_indices[ci][i];
-                affected_points[i] = new_positions[pj];
-                total_weigths += m_weights[pj];
-            }
+    {
+        PROFILE_SCOPE("(7) prediction");
+        m_thread_pool->parallelForChunks(0, padded_N, VERTEX_GRAIN, [&](uint, uint _begin, uint _end) {
+            VertexKernels::predictPositions(m_positions, m_velocities, m_weights.data(), _delta_time, new_positions.data(), _begin, _end);
+        });
+    }
 
-            float function_value = m_functions[ci](affected_points);
-            if (m_types[ci] == INEQUALITY_CONSTRAINT && function_value >= 0.f) {
-                // The constraint is already satisfied so we don't project it
-                continue;
-            }
+    endPhase(PREDICTION_PHASE, phase_start);
 
-            // Determine S
-            gradients.resize(m_cardinalities[ci]);
-            float denominator = 0.f;
-            for (uint i = 0; i < m_cardinalities[ci]; i++) {
-                // uint pj = m_indices[ci][i];
-                gradients[i] = m_gradients[ci](affected_points, i);
-                denominator += length2(gradients[i]);
-            }
-            float s = function_value / denominator;
-
-            // add the deltas
-            for (uint i = 0; i < m_cardinalities[ci]; i++) {
-                uint pj = m_indices[ci][i];
-                glm::vec3 delta_pj = -s * (float(m_cardinalities[ci]) * m_weights[pj] / total_weigths) * gradients[i];
-                new_positions[pj] += delta_pj; // TODO: stiffness factor
-                constraint_evolution += glm::length(delta_pj);
-            }
+    // (8)
+    {
+        PROFILE_SCOPE("(8) collisions");
+        generateCollisionConstraints(new_positions);
+    }
+    endPhase(COLLISION_PHASE, phase_start);
 
-            evolution += constraint_evolution / m_cardinalities[ci];
+    // (9)-(11)
+    {
+        PROFILE_SCOPE("(9)-(11) projection");
+        bool use_xpbd = m_solver_settings.use_xpbd;
+        float inv_dt2 = use_xpbd ? 1.f / (_delta_time * _delta_time) : 0.f;
+        if (use_xpbd) {
+            m_distance_constraints.resetLambdas();
+            m_bending_constraints.resetLambdas();
+            m_volume_constraints.resetLambdas();
+            m_attachment_constraints.resetLambdas();
         }
-        evolution /= float(M);
-    } while (abs(old_evolution - evolution) > 1e-7f);
+
+        ProjectionResult results[CONSTRAINT_FAMILY_COUNT];
+        float old_evolution, evolution;
+        old_evolution = evolution = 0.f;
+        uint iteration = 0;
+        float chebyshev_omega = 1.f;
+        do {
+            projectConstraints(iteration, chebyshev_omega, inv_dt2, new_positions, results);
+            old_evolution = evolution;
+            evolution = 0.f;
+            for (uint family = 0; family < CONSTRAINT_FAMILY_COUNT; family++)
+                evolution += results[family].evolution;
+            evolution /= float(std::max(M + m_solver_stats.contacts, 1u));
+            iteration++;
+        } while (!stopIterating(iteration, old_evolution, evolution, results));
+        m_solver_stats.iterations += iteration;
+    }
+    endPhase(PROJECTION_PHASE, phase_start);
 
     // (12)-(15)
-    for (uint i = 0; i < N; i++) {
-        m_velocities[i] = (new_positions[i] - m_positions[i]) / _delta_time; // (13)
-        m_positions[i] = new_positions[i];                                   // (14)
+    {
+        PROFILE_SCOPE("(12)-(15) velocity update");
+        m_thread_pool->parallelForChunks(0, padded_N, VERTEX_GRAIN, [&](uint, uint _begin, uint _end) {
+            VertexKernels::updatePositions(new_positions.data(), _delta_time, m_positions, m_velocities, _begin, _end);
+        });
     }
 
     // TODO: (16) Velocity update
-    // std::cout << std::endl;
-    // for (uint i = 0; i < N; i++) {
-    //     std::cout << "v" << i << ":" << std::endl
-    //               << "    (" << m_positions[i].x << "," << m_positions[i].y << "," << m_positions[i].z << ")" << std::endl
-    //               << "    (" << m_velocities[i].x << "," << m_velocities[i].y << "," << m_velocities[i].z << ")" << std::endl
-    //               << "    " << m_masses[i] << "\t" << m_weights[i] << std::endl;
-    // }
+    endPhase(UPDATE_PHASE, phase_start);
 }
 
 void DynamicObject::addVertex(const glm::vec3 &_position, const glm::vec3 &_velocity, float _mass, bool _fixed) {
@@ -173,13 +915,53 @@ void DynamicObject::addVertex(const glm::vec3 &_position, const glm::vec3 &_velo
     m_positions.push_back(_position);
     m_velocities.push_back(_velocity);
     m_masses.push_back(_mass);
-    m_weights.push_back(_fixed ? 0.f : 1.f / _mass);
-    m_fixed.push_back(_fixed);
+    m_weights.resize(paddedSize(N), 0.f);
+    m_weights[N - 1] = _fixed ? 0.f : 1.f / _mass;
+    m_original_indices.push_back(N - 1);
+    m_vertex_indices.push_back(N - 1);
+    m_workspace_dirty = true;
+    m_rendered_positions_dirty = true;
+    wake();
+}
+
+void DynamicObject::sweptBounds(float _delta_time, glm::vec3 &_min, glm::vec3 &_max) const {
+    if (m_sleeping) {
+        _min = m_sleeping_min;
+        _max = m_sleeping_max;
+        return;
+    }
+    _min = glm::vec3(FLT_MAX);
+    _max = glm::vec3(-FLT_MAX);
+    for (uint i = 0; i < N; i++) {
+        glm::vec3 x = position(i), p = x + _delta_time * velocity(i);
+        _min = glm::min(_min, glm::min(x, p));
+        _max = glm::max(_max, glm::max(x, p));
+    }
+}
+
+void DynamicObject::correctVertex(uint _pj, const glm::vec3 &_delta, float _delta_time) {
+    m_positions.set(_pj, position(_pj) + _delta);
+    m_velocities.set(_pj, velocity(_pj) + _delta / _delta_time);
+    m_rendered_positions_dirty = true;
+    if (m_sleeping)
+        wake(); // the resting frames of an awake object are kept, resting contacts do not prevent the sleeping
+}
+
+void DynamicObject::addTriangle(uint _p0, uint _p1, uint _p2) {
+    m_triangles.push_back(glm::uvec3(_p0, _p1, _p2));
+    m_workspace_dirty = true;
+    wake();
+}
+
+void DynamicObject::addCollider(const StaticBVH *_collider) {
+    m_colliders.push_back(_collider);
+    m_workspace_dirty = true; // the static contacts are reserved per collider
+    wake();
 }
 
 void DynamicObject::setVertexFixed(uint _pj, bool _fixed) {
-    m_fixed[_pj] = _fixed;
     m_weights[_pj] = _fixed ? 0.f : 1.f / m_masses[_pj];
+    wake();
 }
 
 void DynamicObject::addConstraint(
@@ -190,6 +972,7 @@ void DynamicObject::addConstraint(
     float _stiffness,
     const ConstraintType &_type) {
     M++;
+    invalidateConstraintCaches();
     m_cardinalities.push_back(_cardinality);
     m_functions.push_back(_function);
     m_gradients.push_back(_gradient);
@@ -198,50 +981,347 @@ void DynamicObject::addConstraint(
     m_types.push_back(_type);
 }
 
-void DynamicObject::addDistanceConstraint(uint _p0, uint _p1, float _stiffness, float _targeted_distance) {
+void DynamicObject::addDistanceConstraint(uint _p0, uint _p1, float _stiffness, float _targeted_distance, float _compliance) {
     M++;
-    m_cardinalities.push_back(2);
-    m_indices.push_back({_p0, _p1});
-    m_stiffnesses.push_back(_stiffness);
-    m_types.push_back(EQUALITY_CONSTRAINT);
+    invalidateConstraintCaches();
+    m_distance_constraints.add({_p0, _p1}, _stiffness, _compliance);
+    m_distance_constraints.rest_lengths.push_back(_targeted_distance);
+}
+void DynamicObject::addDistanceConstraint(uint _p0, uint _p1, float _stiffness) {
+    addDistanceConstraint(_p0, _p1, _stiffness, glm::distance(position(_p0), position(_p1)));
+}
 
-    m_functions.push_back([_targeted_distance](const std::vector<glm::vec3> &_p) {
-        return glm::distance(_p[0], _p[1]) - _targeted_distance;
+void DynamicObject::addBendingConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness, float _rest_angle, float _compliance) {
+    M++;
+    invalidateConstraintCaches();
+    m_bending_constraints.add({_p0, _p1, _p2, _p3}, _stiffness, _compliance);
+    m_bending_constraints.rest_angles.push_back(_rest_angle);
+}
+void DynamicObject::addBendingConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness) {
+    float rest_angle = BendingConstraints::dihedralAngle(position(_p0), position(_p1), position(_p2), position(_p3));
+    addBendingConstraint(_p0, _p1, _p2, _p3, _stiffness, rest_angle);
+}
+
+void DynamicObject::addVolumeConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness, float _rest_volume, float _compliance) {
+    M++;
+    invalidateConstraintCaches();
+    m_volume_constraints.add({_p0, _p1, _p2, _p3}, _stiffness, _compliance);
+    m_volume_constraints.rest_volumes.push_back(_rest_volume);
+}
+void DynamicObject::addVolumeConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness) {
+    float rest_volume = VolumeConstraints::volume(position(_p0), position(_p1), position(_p2), position(_p3));
+    addVolumeConstraint(_p0, _p1, _p2, _p3, _stiffness, rest_volume);
+}
+
+void DynamicObject::addAttachmentConstraint(uint _p0, float _stiffness, const glm::vec3 &_target, float _compliance) {
+    M++;
+    invalidateConstraintCaches();
+    m_attachment_constraints.add({_p0}, _stiffness, _compliance);
+    m_attachment_constraints.targets.push_back(_target);
+}
+void DynamicObject::addAttachmentConstraint(uint _p0, float _stiffness) {
+    addAttachmentConstraint(_p0, _stiffness, position(_p0));
+}
+
+void DynamicObject::addShapeMatchingCluster(const std::vector<uint> &_indices, float _stiffness) {
+    M++;
+    invalidateConstraintCaches();
+    std::vector<glm::vec3> positions(N);
+    VertexKernels::pack(m_positions, positions.data(), 0, N);
+    m_shape_matching.add(_indices, positions.data(), m_masses.data(), _stiffness);
+}
+
+/*
+Clusters on a grid of cells of size s: the cluster of an occupied cell gathers the vertices of the cell grown by s / 2
+on every side, so that every vertex belongs to 1 to 8 overlapping clusters (the overlap transmits the motion from one
+cluster to its neighbors). The clusters of less than 3 vertices are dropped.
+*/
+void DynamicObject::addShapeMatchingClusters(float _cluster_size, float _stiffness) {
+    typedef std::pair<glm::ivec3, uint> CellVertex;
+    auto cellLess = [](const glm::ivec3 &_a, const glm::ivec3 &_b) {
+        return _a.x < _b.x || (_a.x == _b.x && (_a.y < _b.y || (_a.y == _b.y && _a.z < _b.z)));
+    };
+    const float inv_size = 1.f / _cluster_size;
+    std::vector<glm::ivec3> occupied(N);
+    std::vector<CellVertex> members;
+    for (uint i = 0; i < N; i++) {
+        glm::vec3 x = position(i) * inv_size;
+        occupied[i] = glm::ivec3(glm::floor(x));
+        glm::ivec3 first = glm::ivec3(glm::floor(x - 0.5f)), last = glm::ivec3(glm::floor(x + 0.5f));
+        glm::ivec3 cell;
+        for (cell.x = first.x; cell.x <= last.x; cell.x++)
+            for (cell.y = first.y; cell.y <= last.y; cell.y++)
+                for (cell.z = first.z; cell.z <= last.z; cell.z++)
+                    members.push_back(CellVertex(cell, i));
+    }
+    std::sort(occupied.begin(), occupied.end(), cellLess);
+    occupied.erase(std::unique(occupied.begin(), occupied.end()), occupied.end());
+    std::sort(members.begin(), members.end(), [&](const CellVertex &_a, const CellVertex &_b) {
+        return cellLess(_a.first, _b.first) || (_a.first == _b.first && _a.second < _b.second);
+    });
+
+    std::vector<uint> indices;
+    for (uint begin = 0, end; begin < members.size(); begin = end) {
+        for (end = begin; end < members.size() && members[end].first == members[begin].first; end++)
+            ;
+        if (end - begin < 3 || !std::binary_search(occupied.begin(), occupied.end(), members[begin].first, cellLess))
+            continue;
+        indices.clear();
+        for (uint k = begin; k < end; k++)
+            indices.push_back(members[k].second);
+        addShapeMatchingCluster(indices, _stiffness);
+    }
+}
+
+/*
+Builds the object from the MeshTopology of the mesh (the one stored with the mesh by Mesh::loadOFF, else built here,
+see MeshTopology::build):
+(1) the welded vertices are added in one go, at their positions in the space of _model
+(2) the batches grow once, then forall edges / pairs (in parallel): write the distance and bending constraints with
+    the rest lengths and angles of the current positions
+The constraints are sorted by vertex, whatever the number of threads.
+Volume: one more vertex at the centroid and one tetrahedron (triangle, centroid) per triangle, whose volumes sum to
+the volume of a closed mesh. Every tetrahedron holds the centroid, so the volume constraints cannot be colored
+(use GAUSS_SEIDEL or JACOBI).
+*/
+std::vector<uint> DynamicObject::addMesh(const Mesh &_mesh, const MeshBuildSettings &_settings, const glm::mat4 &_model) {
+    ThreadPool &thread_pool = *m_thread_pool;
+    const std::vector<glm::vec3> &mesh_positions = _mesh.vertexPositions();
+    const uint V = mesh_positions.size();
+    MeshTopology built;
+    const MeshTopology *topology = _settings.weld ? _mesh.topology() : nullptr;
+    if (!topology || topology->vertex_map.size() != V) {
+        built.build(mesh_positions, _mesh.triangleIndices(), _settings.weld, thread_pool);
+        topology = &built;
+    }
+    const std::vector<uint> &vertex_map = topology->vertex_map;
+    const std::vector<glm::uvec3> &triangles = topology->triangles;
+
+    // (1)
+    std::vector<glm::vec3> positions(V);
+    thread_pool.parallelFor(0, V, VERTEX_GRAIN, [&](uint _i) {
+        positions[_i] = glm::vec3(_model * glm::vec4(mesh_positions[_i], 1.f));
+    });
+    const bool add_centroid = _settings.volume_stiffness > 0.f && topology->vertex_count > 0;
+    const uint first = N;
+    N += topology->vertex_count + add_centroid;
+    m_positions.resize(N);
+    m_velocities.resize(N);
+    m_masses.resize(N, _settings.mass);
+    m_weights.resize(paddedSize(N), 0.f);
+    std::fill(m_weights.begin() + first, m_weights.begin() + N, 1.f / _settings.mass);
+    m_original_indices.resize(N);
+    m_vertex_indices.resize(N);
+    for (uint i = 0; i < V; i++)
+        m_positions.set(first + vertex_map[i], positions[i]);
+    for (uint i = first; i < N; i++)
+        m_original_indices[i] = m_vertex_indices[i] = i; // the objects built this way are not reordered yet
+    glm::vec3 centroid(0.f);
+    if (add_centroid) {
+        for (uint i = first; i < first + topology->vertex_count; i++)
+            centroid += position(i);
+        centroid /= float(topology->vertex_count);
+        m_positions.set(N - 1, centroid);
+    }
+
+    // (2)
+    const uint edge_count = _settings.distance_stiffness > 0.f ? topology->edges.size() : 0;
+    const uint pair_count = _settings.bending_stiffness > 0.f ? topology->bending_pairs.size() : 0;
+    const uint volume_count = add_centroid ? triangles.size() : 0;
+    const uint first_edge = m_distance_constraints.grow(edge_count, _settings.distance_stiffness, _settings.compliance);
+    const uint first_pair = m_bending_constraints.grow(pair_count, _settings.bending_stiffness, _settings.compliance);
+    const uint first_volume = m_volume_constraints.grow(volume_count, _settings.volume_stiffness, _settings.compliance);
+    m_distance_constraints.rest_lengths.resize(m_distance_constraints.size());
+    m_bending_constraints.rest_angles.resize(m_bending_constraints.size());
+    m_volume_constraints.rest_volumes.resize(m_volume_constraints.size());
+    thread_pool.parallelFor(0, edge_count, CONSTRAINT_GRAIN, [&](uint _e) {
+        const glm::uvec2 edge = topology->edges[_e] + glm::uvec2(first);
+        m_distance_constraints.indices[first_edge + _e] = {edge.x, edge.y};
+        m_distance_constraints.rest_lengths[first_edge + _e] = glm::distance(position(edge.x), position(edge.y));
     });
-    m_gradients.push_back([_targeted_distance](const std::vector<glm::vec3> &_p, uint _pj) {
-        glm::vec3 n = glm::normalize(_p[0] - _p[1]);
-        return _pj == 0 ? n : -n;
+    thread_pool.parallelFor(0, pair_count, CONSTRAINT_GRAIN, [&](uint _p) {
+        const glm::uvec4 pair = topology->bending_pairs[_p] + glm::uvec4(first);
+        m_bending_constraints.indices[first_pair + _p] = {pair.x, pair.y, pair.z, pair.w};
+        m_bending_constraints.rest_angles[first_pair + _p] = BendingConstraints::dihedralAngle(position(pair.x), position(pair.y), position(pair.z), position(pair.w));
     });
+    thread_pool.parallelFor(0, volume_count, CONSTRAINT_GRAIN, [&](uint _t) {
+        const glm::uvec3 triangle = triangles[_t] + glm::uvec3(first);
+        m_volume_constraints.indices[first_volume + _t] = {triangle.x, triangle.y, triangle.z, N - 1};
+        m_volume_constraints.rest_volumes[first_volume + _t] = VolumeConstraints::volume(position(triangle.x), position(triangle.y), position(triangle.z), centroid);
+    });
+    M += edge_count + pair_count + volume_count;
+
+    if (_settings.collision_surface) {
+        m_triangles.reserve(m_triangles.size() + triangles.size());
+        for (const glm::uvec3 &triangle : triangles)
+            m_triangles.push_back(triangle + glm::uvec3(first));
+    }
+    m_workspace_dirty = true;
+    m_rendered_positions_dirty = true;
+    invalidateConstraintCaches();
+
+    std::vector<uint> vertices(V);
+    for (uint i = 0; i < V; i++)
+        vertices[i] = first + vertex_map[i];
+    return vertices;
 }
-void DynamicObject::addDistanceConstraint(uint _p0, uint _p1, float _stiffness) {
-    addDistanceConstraint(_p0, _p1, _stiffness, glm::distance(m_positions[_p0], m_positions[_p1]));
+
+template <class Batch>
+void DynamicObject::remapBatch(Batch &_batch, const std::vector<uint> &_new_indices) {
+    std::vector<uint> lowest(_batch.size());
+    for (uint ci = 0; ci < _batch.size(); ci++) {
+        lowest[ci] = UINT_MAX;
+        for (uint &index : _batch.indices[ci]) {
+            index = _new_indices[index];
+            lowest[ci] = std::min(lowest[ci], index);
+        }
+    }
+    std::vector<uint> order(_batch.size());
+    for (uint ci = 0; ci < _batch.size(); ci++)
+        order[ci] = ci;
+    std::stable_sort(order.begin(), order.end(), [&](uint _a, uint _b) { return lowest[_a] < lowest[_b]; });
+    _batch.permute(order);
+    _batch.color_offsets.clear();
 }
 
-// OpenGL uinterface
+/*
+Locality pass, for objects built in an arbitrary order (e.g. from an OFF mesh), so that the constraints gather
+vertices which are close in memory:
+(1) the vertices are permuted along a Morton curve, or by reverse Cuthill-McKee on the graph of the constraints
+    and of the triangles (see VertexOrdering.hpp)
+(2) every vertex index is remapped: constraints, generic constraints, shape matching clusters, triangles, rendered lines
+(3) the constraints of every family (and the triangles) are sorted by their lowest vertex index
+The coloring and the Jacobi adjacency are recomputed by the next update (a color keeps the order of its constraints).
+The transient contacts are dropped. originalIndex / vertexIndex translate between the two numberings.
+*/
+void DynamicObject::reorderVertices(VertexOrder _order) {
+    if (N == 0)
+        return;
+
+    // (1)
+    std::vector<uint> order;
+    if (_order == MORTON_ORDER) {
+        std::vector<glm::vec3> positions(N);
+        VertexKernels::pack(m_positions, positions.data(), 0, N);
+        order = VertexOrdering::mortonOrder(positions);
+    } else {
+        std::vector<glm::uvec2> edges;
+        auto addEdges = [&](const uint *_indices, uint _count) {
+            for (uint a = 0; a < _count; a++)
+                for (uint b = a + 1; b < _count; b++)
+                    edges.push_back(glm::uvec2(_indices[a], _indices[b]));
+        };
+        for (const std::array<uint, 2> &indices : m_distance_constraints.indices)
+            addEdges(indices.data(), 2);
+        for (const std::array<uint, 4> &indices : m_bending_constraints.indices)
+            addEdges(indices.data(), 4);
+        for (const std::array<uint, 4> &indices : m_volume_constraints.indices)
+            addEdges(indices.data(), 4);
+        for (const std::vector<uint> &indices : m_indices)
+            addEdges(indices.data(), indices.size());
+        for (uint c = 0; c < m_shape_matching.size(); c++) // a chain through every cluster
+            for (uint pair = m_shape_matching.offsets[c]; pair + 1 < m_shape_matching.offsets[c + 1]; pair++)
+                edges.push_back(glm::uvec2(m_shape_matching.indices[pair], m_shape_matching.indices[pair + 1]));
+        for (const glm::uvec3 &triangle : m_triangles)
+            addEdges(&triangle[0], 3);
+        order = VertexOrdering::reverseCuthillMcKeeOrder(N, edges);
+    }
+    std::vector<uint> new_indices = VertexOrdering::inverse(order);
+
+    Vec3Arrays positions, velocities;
+    positions.resize(N);
+    velocities.resize(N);
+    std::vector<float> masses(N);
+    AlignedFloats weights(m_weights.size(), 0.f);
+    std::vector<uint> original_indices(N);
+    for (uint i = 0; i < N; i++) {
+        positions.set(i, m_positions.get(order[i]));
+        velocities.set(i, m_velocities.get(order[i]));
+        masses[i] = m_masses[order[i]];
+        weights[i] = m_weights[order[i]];
+        original_indices[i] = m_original_indices[order[i]];
+        m_vertex_indices[original_indices[i]] = i;
+    }
+    std::swap(m_positions, positions);
+    std::swap(m_velocities, velocities);
+    m_masses.swap(masses);
+    m_weights.swap(weights);
+    m_original_indices.swap(original_indices);
+
+    // (2) and (3)
+    remapBatch(m_distance_constraints, new_indices);
+    remapBatch(m_bending_constraints, new_indices);
+    remapBatch(m_volume_constraints, new_indices);
+    remapBatch(m_attachment_constraints, new_indices);
+
+    std::vector<uint> lowest(m_indices.size());
+    for (uint ci = 0; ci < m_indices.size(); ci++) {
+        lowest[ci] = UINT_MAX;
+        for (uint &index : m_indices[ci]) {
+            index = new_indices[index];
+            lowest[ci] = std::min(lowest[ci], index);
+        }
+    }
+    std::vector<uint> generic_order(m_indices.size());
+    for (uint ci = 0; ci < m_indices.size(); ci++)
+        generic_order[ci] = ci;
+    std::stable_sort(generic_order.begin(), generic_order.end(), [&](uint _a, uint _b) { return lowest[_a] < lowest[_b]; });
+    auto permuteGeneric = [&](auto &_array) {
+        typename std::remove_reference<decltype(_array)>::type permuted(_array.size());
+        for (uint ci = 0; ci < generic_order.size(); ci++)
+            permuted[ci] = std::move(_array[generic_order[ci]]);
+        _array.swap(permuted);
+    };
+    permuteGeneric(m_cardinalities);
+    permuteGeneric(m_functions);
+    permuteGeneric(m_gradients);
+    permuteGeneric(m_indices);
+    permuteGeneric(m_stiffnesses);
+    permuteGeneric(m_types);
 
-void DynamicObject::initRendering() {
-    glGenVertexArrays(1, &m_VAO);
-    glBindVertexArray(m_VAO);
+    for (uint &index : m_shape_matching.indices)
+        index = new_indices[index];
+
+    for (glm::uvec3 &triangle : m_triangles)
+        triangle = glm::uvec3(new_indices[triangle.x], new_indices[triangle.y], new_indices[triangle.z]);
+    std::stable_sort(m_triangles.begin(), m_triangles.end(), [](const glm::uvec3 &_a, const glm::uvec3 &_b) {
+        return std::min(std::min(_a.x, _a.y), _a.z) < std::min(std::min(_b.x, _b.y), _b.z);
+    });
 
-    glGenBuffers(1, &m_positions_VBO);
-    updateRenderedPositions();
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    for (glm::uvec2 &line : m_lines)
+        line = glm::uvec2(new_indices[line.x], new_indices[line.y]);
 
-    glGenBuffers(1, &m_lines_EBO);
-    updateRenderedConstraints();
+    m_particle_contacts.clear();
+    m_triangle_contacts.clear();
+    m_static_contacts.clear();
+    invalidateConstraintCaches();
 
-    glBindVertexArray(0);
+    // the buffers already uploaded follow the new numbering
+    m_rendered_positions_dirty = true;
+    m_lines_version++;
 }
 
-void DynamicObject::updateRenderedPositions() {
-    glBindBuffer(GL_ARRAY_BUFFER, m_positions_VBO);
-    glBufferData(GL_ARRAY_BUFFER, m_positions.size() * sizeof(glm::vec3), m_positions.data(), GL_STATIC_DRAW);
+// Rendering
+
+template <class Batch>
+void DynamicObject::appendRenderedLines(const Batch &_batch) {
+    const uint np = Batch::cardinality;
+    for (uint ci = 0; ci < _batch.size(); ci++) {
+        for (uint i = 0; i < (np > 2 ? np : 1); i++) {
+            uint pj1 = _batch.indices[ci][i % np];
+            uint pj2 = _batch.indices[ci][(i + 1) % np];
+            m_lines.push_back(glm::uvec2(pj1, pj2));
+        }
+    }
 }
 
 void DynamicObject::updateRenderedConstraints() {
     m_lines.resize(0);
-    for (uint ci = 0; ci < M; ci++) {
+    appendRenderedLines(m_distance_constraints);
+    appendRenderedLines(m_bending_constraints);
+    appendRenderedLines(m_volume_constraints);
+    appendRenderedLines(m_attachment_constraints);
+    for (uint ci = 0; ci < m_cardinalities.size(); ci++) {
         uint np = m_cardinalities[ci];
         for (uint i = 0; i < (np > 2 ? np : 1); i++) {
             uint pj1 = m_indices[ci][i % np];
@@ -249,17 +1329,7 @@ void DynamicObject::updateRenderedConstraints() {
             m_lines.push_back(glm::uvec2(pj1, pj2));
         }
     }
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_lines_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_lines.size() * sizeof(glm::uvec2), m_lines.data(), GL_STATIC_DRAW);
-}
-
-void DynamicObject::render() {
-    glBindVertexArray(m_VAO); // Activate the VAO storing geometry data
-    // glDrawArrays(GL_TRIANGLE_STRIP, 0, m_positions.size());
-    // glDrawArrays(GL_LINE_STRIP, 0, m_positions.size());
-    // glDrawArrays(GL_POINTS, 0, m_positions.size());
-    glDrawElements(GL_LINES, m_lines.size() * 2, GL_UNSIGNED_INT, 0);
+    m_lines_version++;
 }
 
 void DynamicObject::clear() {
@@ -268,27 +1338,29 @@ void DynamicObject::clear() {
     m_velocities.clear();
     m_masses.clear();
     m_weights.clear();
-    m_fixed.clear();
+    m_original_indices.clear();
+    m_vertex_indices.clear();
 
     M = 0;
+    invalidateConstraintCaches();
+    m_distance_constraints.clear();
+    m_bending_constraints.clear();
+    m_volume_constraints.clear();
+    m_attachment_constraints.clear();
+    m_shape_matching.clear();
     m_cardinalities.clear();
     m_functions.clear();
     m_gradients.clear();
     m_indices.clear();
     m_stiffnesses.clear();
     m_types.clear();
+    m_triangles.clear();
+    m_particle_contacts.clear();
+    m_triangle_contacts.clear();
+    m_colliders.clear();
+    m_static_contacts.clear();
     m_lines.clear();
-
-    if (m_VAO) {
-        glDeleteVertexArrays(1, &m_VAO);
-        m_VAO = 0;
-    }
-    if (m_positions_VBO) {
-        glDeleteBuffers(1, &m_positions_VBO);
-        m_positions_VBO = 0;
-    }
-    if (m_lines_EBO) {
-        glDeleteBuffers(1, &m_lines_EBO);
-        m_lines_EBO = 0;
-    }
+    m_lines_version++;
+    m_rendered_positions_dirty = true;
+    wake();
 }
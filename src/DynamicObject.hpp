@@ -1,28 +1,144 @@
 #pragma once
 
+#include "BVH.hpp"
 #include "Mesh.hpp"
 #include "Transformation.hpp"
+#include "Constraints.hpp"
+#include "SpatialHash.hpp"
+#include "ThreadPool.hpp"
+#include "VertexArrays.hpp"
+#include "VertexOrdering.hpp"
+#include <chrono>
 #include <functional>
 
 typedef std::function<float(const std::vector<glm::vec3> &)> constraint_function;
 typedef std::function<glm::vec3(const std::vector<glm::vec3> &, uint)> gradient_function;
 
-enum ConstraintType {
-    EQUALITY_CONSTRAINT,
-    INEQUALITY_CONSTRAINT,
+// g: acceleration applied to every vertex at step (5) (see DynamicObject::step), m.s⁻²
+static const glm::vec3 GRAVITY = glm::vec3(0.f, -9.807f, 0.f);
+
+enum SolverMode {
+    GAUSS_SEIDEL,         // Constraints projected one after the other on the calling thread
+    COLORED_GAUSS_SEIDEL, // Constraints grouped by graph color, each color projected in parallel
+    JACOBI,               // Every constraint reads the same positions, the corrections are averaged per vertex
+};
+
+enum ConstraintFamily {
+    DISTANCE_CONSTRAINTS,
+    BENDING_CONSTRAINTS,
+    VOLUME_CONSTRAINTS,
+    ATTACHMENT_CONSTRAINTS,
+    SHAPE_MATCHING_CONSTRAINTS,
+    COLLISION_CONSTRAINTS,
+    GENERIC_CONSTRAINTS,
+    CONSTRAINT_FAMILY_COUNT,
+};
+
+// Phases of one (sub)step timed by DynamicObject::update
+enum SolverPhase {
+    PREDICTION_PHASE, // (5)-(7) external forces, damping, pi ← xi + ∆t vi
+    COLLISION_PHASE,  // (8)
+    PROJECTION_PHASE, // (9)-(11)
+    UPDATE_PHASE,     // (12)-(16)
+    SOLVER_PHASE_COUNT,
+};
+
+struct SolverSettings {
+    SolverMode mode = GAUSS_SEIDEL;
+
+    // Stopping policy of the projection loop (see DynamicObject::stopIterating)
+    uint max_iterations = 100;                                                                     // PBD: hard cap on the iterations of one step
+    float tolerances[CONSTRAINT_FAMILY_COUNT] = {1e-4f, 1e-3f, 1e-6f, 1e-4f, 1e-4f, 1e-4f, 1e-4f}; // max |Cj| accepted per family (in the unit of Cj, |gi - pi| for the clusters)
+    float stagnation_tolerance = 1e-7f;                                                            // PBD: stop when the mean displacement stops evolving
+    float time_budget = 0.f;                                                                       // seconds for a whole update(), 0 -> unlimited
+
+    // JACOBI
+    float jacobi_relaxation = 1.f; // ω: the averaged corrections are scaled by ω (over-relaxation if > 1)
+    float chebyshev_rho = 0.9f;    // ρ: estimated spectral radius of the Jacobi iteration, 0 disables the Chebyshev acceleration
+    uint chebyshev_delay = 5;      // S: number of plain Jacobi iterations before the acceleration starts
+
+    // Shape matching clusters (see DynamicObject::projectShapeMatching)
+    uint rotation_iterations = 2; // iterations of the rotation extraction per projection, warm-started from the last one
+
+    // XPBD ("Extended Position Based Dynamics"): compliances replace stiffnesses, the result no longer depends on the iteration count
+    bool use_xpbd = false;
+    uint substeps = 1;        // the frame is split in substeps of ∆t / substeps
+    uint xpbd_iterations = 1; // solver iterations per substep
+
+    // Collisions, generated at step (8) (see DynamicObject::generateCollisionConstraints)
+    bool self_collisions = false;
+    float collision_thickness = 0.02f; // h: distance kept between two particles, a vertex and a triangle, a vertex and a collider (below the edge lengths)
+    float collision_stiffness = 1.f;   // kj of the generated constraints (PBD)
+
+    // Sleeping (see DynamicObject::updateResting)
+    float sleep_energy = 0.02f; // kinetic energy per unit mass (½ ∑ mi vi² / ∑ mi) below which the object rests, above ½ (|g| ∆t)² at 60 Hz
+    uint sleep_frames = 60;     // consecutive resting updates before the object sleeps, 0 disables the sleeping
+};
+
+// How DynamicObject::addMesh turns the triangles of a Mesh into vertices and constraints (a stiffness of 0 skips the family)
+struct MeshBuildSettings {
+    float mass = 1.f;                      // mi of every vertex
+    float distance_stiffness = 1.f;        // kj of the edges
+    float bending_stiffness = 0.1f;        // kj of the pairs of triangles sharing an edge
+    float volume_stiffness = 0.f;          // kj of the tetrahedra (triangle, centroid) of a closed mesh (see addMesh)
+    float compliance = DERIVED_COMPLIANCE; // αj of every constraint (XPBD), by default derived from the kj of its family
+    bool weld = true;                      // the vertices at exactly the same position become one (e.g. the seams of Mesh::setCube)
+    bool collision_surface = true;         // the triangles are added for the self collisions
+};
+
+// Reported by DynamicObject::update
+struct SolverStats {
+    uint iterations = 0;                           // projection iterations, summed over the substeps
+    float residuals[CONSTRAINT_FAMILY_COUNT] = {}; // max |Cj| per family measured during the last iteration
+    bool converged = false;                        // every residual was below its tolerance
+    bool out_of_time = false;                      // the time budget stopped the iterations
+    uint contacts = 0;                             // collision constraints generated by the last (sub)step
+    bool sleeping = false;                         // the object slept through the update, nothing was computed
+    size_t heap_allocations = 0;                   // made by the updating thread (counted in DEBUG and COUNT_HEAP_ALLOCATIONS builds only)
+    bool steady = false;                           // the workspace was reserved and the collision buffers did not grow: no heap allocation
+    float phase_times[SOLVER_PHASE_COUNT] = {};    // seconds spent in every phase, summed over the substeps
+};
+
+// Partial sums of DynamicObject::dampVelocities over a chunk of vertices
+struct MassMoments {
+    float mass = 0.f;                            // ∑ mi
+    glm::vec3 position = glm::vec3(0.f);         // ∑ mi xi
+    glm::vec3 velocity = glm::vec3(0.f);         // ∑ mi vi
+    glm::vec3 angular_momentum = glm::vec3(0.f); // ∑ xi × mi vi
+    glm::mat3 second_moment = glm::mat3(0.f);    // ∑ mi xi xiT
+
+    inline void add(const MassMoments &_other) {
+        mass += _other.mass;
+        position += _other.position;
+        velocity += _other.velocity;
+        angular_momentum += _other.angular_momentum;
+        second_moment += _other.second_moment;
+    }
 };
 
 class DynamicObject {
-    // Verticies
-    uint N = 0;                          // number of vertices
-    std::vector<glm::vec3> m_positions;  // xi
-    std::vector<glm::vec3> m_velocities; // vi
-    std::vector<float> m_masses;         // mi
-    std::vector<float> m_weights;        // wi
-    std::vector<bool> m_fixed;           // if the vertex is fixed
+    // Verticies, as structures of arrays padded to paddedSize(N) for the SIMD kernels (see VertexArrays.hpp)
+    uint N = 0;                  // number of vertices
+    Vec3Arrays m_positions;      // xi
+    Vec3Arrays m_velocities;     // vi
+    std::vector<float> m_masses; // mi
+    AlignedFloats m_weights;     // wi = 1 / mi, 0 if the vertex is fixed
+
+    // Insertion order <-> storage order (see reorderVertices)
+    std::vector<uint> m_original_indices; // index given by addVertex to every vertex
+    std::vector<uint> m_vertex_indices;   // current index of every vertex, by original index
 
     // Constraints
-    uint M = 0;                                   // number of contraints
+    uint M = 0; // number of contraints (all families)
+
+    // Built-in constraint families, projected with inlined kernels
+    DistanceConstraints m_distance_constraints;
+    BendingConstraints m_bending_constraints;
+    VolumeConstraints m_volume_constraints;
+    AttachmentConstraints m_attachment_constraints;
+    ShapeMatchingClusters m_shape_matching;
+
+    // Generic constraints (slower fallback, see addConstraint)
     std::vector<uint> m_cardinalities;            // nj: The number of impacted vertices
     std::vector<constraint_function> m_functions; // Cj: The constraint itself. Input's size must match the cardinality
     std::vector<gradient_function> m_gradients;   // Cj: The gradient (evolution) of the constraint. Input's size must match the cardinality
@@ -30,9 +146,105 @@ class DynamicObject {
     std::vector<float> m_stiffnesses;             // kj: Strength in [0;1]
     std::vector<ConstraintType> m_types;          // Either Equality (=0) or Inequality (>=0)
 
+    // Collisions (step (8)): the broad phase hashes the swept boxes of the vertices (xi -> pi), the narrow phase
+    // computes the time of impact of the particle pairs and vertex-triangle pairs (continuous collision detection)
+    // and turns them into transient inequality constraints, projected in place.
+    // The static colliders are queried through their BVH.
+    struct ParticleContact {
+        std::array<uint, 2> indices;
+        glm::vec3 normal;
+    };
+    struct TriangleContact {
+        std::array<uint, 4> indices; // vertex, then the triangle
+        glm::vec3 barycentric;
+        float side;
+    };
+    std::vector<glm::uvec3> m_triangles; // surface of the object
+    float m_collision_cell_size = 0.f;   // mean of the longest edge of the triangles
+    SpatialHash m_spatial_hash;
+    std::vector<glm::vec3> m_swept_mins; // swept box of every vertex during the step
+    std::vector<glm::vec3> m_swept_maxs; //
+    std::vector<float> m_chunk_sweeps;   // largest swept box edge of every chunk
+    ParticleContactConstraints m_particle_contacts;
+    TriangleContactConstraints m_triangle_contacts;
+    std::vector<std::vector<ParticleContact>> m_chunk_particle_contacts; // per-chunk output of the narrow phase
+    std::vector<std::vector<TriangleContact>> m_chunk_triangle_contacts; //
+    std::vector<const StaticBVH *> m_colliders;
+    StaticContactConstraints m_static_contacts;
+    std::vector<std::vector<StaticContact>> m_chunk_static_contacts;
+
+    // Solver
+    SolverSettings m_solver_settings;
+    ThreadPool *m_thread_pool = &ThreadPool::global();
+    SolverStats m_solver_stats;
+    std::chrono::steady_clock::time_point m_step_start;
+
+    // Sleeping: a resting object is skipped by update until something wakes it
+    bool m_sleeping = false;
+    bool m_sleeps_alone = true; // false when a PhysicsWorld puts the whole island to sleep
+    uint m_resting_frames = 0;  // consecutive updates with a kinetic energy below sleep_energy
+    glm::vec3 m_sleeping_min;   // bounds of the vertices while sleeping
+    glm::vec3 m_sleeping_max;   //
+
+    // Workspace reused by every step, so that a step does no heap allocation once it is sized
+    bool m_workspace_dirty = true;                 // vertices or constraints were added since the last reserveWorkspace
+    std::vector<glm::vec3> m_new_positions;        // pi (AoS, padded)
+    std::vector<glm::vec3> m_affected_points;      // input of the generic constraints
+    std::vector<glm::vec3> m_affected_gradients;   // output of the generic gradients
+    std::vector<ProjectionResult> m_chunk_results; // per-chunk partial results of the parallel projection
+    std::vector<MassMoments> m_chunk_moments;      // per-chunk partial sums of dampVelocities
+    std::vector<glm::vec2> m_chunk_energies;       // per-chunk (∑ mi, ∑ ½ mi vi²) of updateResting
+
+    // COLORED_GAUSS_SEIDEL
+    bool m_coloring_dirty = true; // constraints were added since the last coloring
+
+    // JACOBI: every (constraint, vertex) pair owns a slot where the constraint writes its correction
+    bool m_adjacency_dirty = true;               // constraints were added or reordered since the last adjacency
+    std::vector<uint> m_vertex_slot_offsets;     // CSR: the slots of vertex i are m_vertex_slots[m_vertex_slot_offsets[i]; m_vertex_slot_offsets[i + 1][
+    std::vector<uint> m_vertex_slots;            //
+    std::vector<glm::vec3> m_slot_deltas;        // ∆pi of every slot
+    std::vector<glm::vec3> m_previous_positions; // q(k-1) for the Chebyshev acceleration
+
+    inline void invalidateConstraintCaches() {
+        m_workspace_dirty = m_coloring_dirty = m_adjacency_dirty = true;
+        wake(); // a constraint change wakes the object
+    }
+
     // "3.5. Damping" of ./articles/Position_Based_Dynamics.pdf
     void dampVelocities(float k_damping = 1.f); // k_damping = 1. -> rigid body
 
+    void computeColoring();
+    template <class Batch>
+    ProjectionResult projectBatch(Batch &_batch, float _inv_dt2, std::vector<glm::vec3> &_new_positions);
+
+    void computeAdjacency();
+    template <class Batch>
+    void appendSlots(const Batch &_batch, uint &_slot, bool _count);
+    template <class Batch>
+    ProjectionResult computeBatchDeltas(Batch &_batch, uint _first_slot, float _inv_dt2, const std::vector<glm::vec3> &_new_positions);
+    void jacobiIteration(uint _iteration, float &_chebyshev_omega, float _inv_dt2, std::vector<glm::vec3> &_new_positions, ProjectionResult *_results);
+    ProjectionResult projectShapeMatching(std::vector<glm::vec3> &_new_positions);
+
+    // (10) one iteration over every constraint, _results is indexed by ConstraintFamily
+    void projectConstraints(uint _iteration, float &_chebyshev_omega, float _inv_dt2, std::vector<glm::vec3> &_new_positions, ProjectionResult *_results);
+    bool stopIterating(uint _iteration, float _old_evolution, float _evolution, const ProjectionResult *_results);
+    inline void endPhase(SolverPhase _phase, std::chrono::steady_clock::time_point &_phase_start) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        m_solver_stats.phase_times[_phase] += std::chrono::duration<float>(now - _phase_start).count();
+        _phase_start = now;
+    }
+    void step(float _delta_time); // (5)-(16) for one (sub)step
+    void generateCollisionConstraints(const std::vector<glm::vec3> &_new_positions); // (8)
+    size_t collisionCapacity() const; // of the self collision buffers, which grow with the contacts
+    ProjectionResult projectCollisionConstraints(float _inv_dt2, std::vector<glm::vec3> &_new_positions);
+    ProjectionResult projectGenericConstraint(uint _ci, std::vector<glm::vec3> &_new_positions);
+
+    template <class Batch>
+    static void remapBatch(Batch &_batch, const std::vector<uint> &_new_indices);
+
+    template <class Batch>
+    void appendRenderedLines(const Batch &_batch);
+
     void fillMissingVertexInfos() {
         m_velocities.resize(N);
         m_masses.resize(N);
@@ -40,10 +252,46 @@ class DynamicObject {
 
 public:
     // "3.1. Algorithm Overview" of ./articles/Position_Based_Dynamics.pdf
-    void update(float _delta_time);
+    const SolverStats &update(float _delta_time);
+
+    inline const SolverSettings &solverSettings() const { return m_solver_settings; }
+    inline SolverSettings &solverSettings() { return m_solver_settings; }
+    void reserveWorkspace();                                                 // sizes the per-step buffers (also done by PhysicsWorld::initRendering and lazily by update)
+    inline const SolverStats &solverStats() const { return m_solver_stats; } // of the last update
+    inline void setThreadPool(ThreadPool *_thread_pool) { m_thread_pool = _thread_pool; }
+
+    // Sleeping: update and updateRenderedPositions do nothing while the object sleeps. The object wakes when a vertex,
+    // a constraint, a triangle or a collider is added, when a contact corrects a vertex, or by wake.
+    inline bool isSleeping() const { return m_sleeping; }
+    inline bool isResting() const { return m_solver_settings.sleep_frames > 0 && m_resting_frames >= m_solver_settings.sleep_frames; }
+    bool updateResting(); // measures the kinetic energy after a step, returns isResting() (called by update if the object sleeps alone)
+    void sleep();         // vi ← 0 until the object wakes
+    inline void wake() {
+        m_sleeping = false;
+        m_resting_frames = 0;
+    }
+    inline void setSleepsAlone(bool _sleeps_alone) { m_sleeps_alone = _sleeps_alone; } // false: the caller decides when to sleep
 
     void addVertex(const glm::vec3 &_position, const glm::vec3 &_velocity, float _mass, bool _fixed);
     void setVertexFixed(uint _pj, bool _fixed);
+    inline uint vertexCount() const { return N; }
+    inline glm::vec3 position(uint _pj) const { return m_positions.get(_pj); }
+    inline glm::vec3 velocity(uint _pj) const { return m_velocities.get(_pj); }
+    inline void packPositions(glm::vec3 *_positions) const { VertexKernels::pack(m_positions, _positions, 0, N); } // AoS copy of every xi
+    inline bool isVertexFixed(uint _pj) const { return m_weights[_pj] == 0.f; }
+    inline float inverseMass(uint _pj) const { return m_weights[_pj]; }
+    inline uint constraintCount() const { return M; }
+    inline uint triangleCount() const { return m_triangles.size(); }
+    void sweptBounds(float _delta_time, glm::vec3 &_min, glm::vec3 &_max) const; // box of every xi and xi + ∆t vi (cached while sleeping)
+    void correctVertex(uint _pj, const glm::vec3 &_delta, float _delta_time);    // xi ← xi + ∆x, vi ← vi + ∆x / ∆t (contacts solved outside of update), wakes the object
+
+    void addTriangle(uint _p0, uint _p1, uint _p2); // part of the surface used by the self collisions
+    void addCollider(const StaticBVH *_collider);   // static geometry the vertices collide with, must outlive the object
+
+    // One-shot locality pass once the object is built: every vertex index changes, the original ones are kept
+    void reorderVertices(VertexOrder _order = MORTON_ORDER);
+    inline uint originalIndex(uint _pj) const { return m_original_indices[_pj]; }         // index given by addVertex
+    inline uint vertexIndex(uint _original) const { return m_vertex_indices[_original]; } // current index of a vertex
 
     void addConstraint(
         uint _cardinality,
@@ -52,21 +300,38 @@ public:
         const std::vector<uint> &_indices,
         float _stiffness,
         const ConstraintType &_type);
-    void addDistanceConstraint(uint _p0, uint _p1, float _stiffness, float _targeted_distance);
+    // _stiffness is used by PBD, _compliance (inverse stiffness) by XPBD, derived from _stiffness when not given (see
+    // complianceFromStiffness)
+    void addDistanceConstraint(uint _p0, uint _p1, float _stiffness, float _targeted_distance, float _compliance = DERIVED_COMPLIANCE);
     void addDistanceConstraint(uint _p0, uint _p1, float _stiffness); // the targeted distance is set to the current distance between p0 and p1
+    void addBendingConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness, float _rest_angle, float _compliance = DERIVED_COMPLIANCE);
+    void addBendingConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness); // triangles (p0, p2, p1) and (p0, p1, p3), the rest angle is the current dihedral angle
+    void addVolumeConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness, float _rest_volume, float _compliance = DERIVED_COMPLIANCE);
+    void addVolumeConstraint(uint _p0, uint _p1, uint _p2, uint _p3, float _stiffness); // the rest volume is the current volume of the tetrahedron
+    void addAttachmentConstraint(uint _p0, float _stiffness, const glm::vec3 &_target, float _compliance = DERIVED_COMPLIANCE);
+    void addAttachmentConstraint(uint _p0, float _stiffness); // the target is the current position of p0
+    // Stiff, near-rigid bodies: one cluster replaces the distance constraints between its vertices
+    void addShapeMatchingCluster(const std::vector<uint> &_indices, float _stiffness); // the rest shape is the current one
+    void addShapeMatchingClusters(float _cluster_size, float _stiffness);              // overlapping clusters covering every vertex (see the definition)
+    // Cloth or soft body from the triangles of a Mesh (in the space of _model): unique edges, bending pairs, optional
+    // volume. Returns the vertex of the object made from every vertex of the mesh.
+    std::vector<uint> addMesh(const Mesh &_mesh, const MeshBuildSettings &_settings = MeshBuildSettings(), const glm::mat4 &_model = glm::mat4(1.f));
 
-    // OpenGL interface
+    // Rendering: the lines and the positions are drawn by the ObjectBatch of the world, with those of the other objects
 private:
-    GLuint m_VAO;
-    GLuint m_positions_VBO;
-
-    GLuint m_lines_EBO;
     std::vector<glm::uvec2> m_lines;
+    uint m_lines_version = 0;               // incremented whenever m_lines change
+    bool m_rendered_positions_dirty = true; // xi changed since the last upload (never while sleeping)
 
 public:
-    void initRendering();
-    void updateRenderedPositions();
-    void updateRenderedConstraints();
-    void render();
+    void updateRenderedConstraints(); // one line per edge of every constraint
+    inline const std::vector<glm::uvec2> &renderedLines() const { return m_lines; }
+    inline uint renderedLinesVersion() const { return m_lines_version; }
+    // True once after xi changed: the uploaded positions are outdated
+    inline bool takeRenderedPositionsDirty() {
+        bool dirty = m_rendered_positions_dirty;
+        m_rendered_positions_dirty = false;
+        return dirty;
+    }
     void clear();
 };
@@ -0,0 +1,40 @@
+#include "MappedFile.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void MappedFile::open(const std::string &_filename) {
+    close();
+    int file = ::open(_filename.c_str(), O_RDONLY);
+    if (file < 0)
+        throw std::runtime_error(_filename + ": " + strerror(errno));
+    struct stat status;
+    if (fstat(file, &status) != 0) {
+        int error = errno;
+        ::close(file);
+        throw std::runtime_error(_filename + ": " + strerror(error));
+    }
+    if (status.st_size == 0) {
+        ::close(file);
+        throw std::runtime_error(_filename + ": empty file");
+    }
+    void *data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    int error = errno;
+    ::close(file); // the mapping keeps the file alive
+    if (data == MAP_FAILED)
+        throw std::runtime_error(_filename + ": " + strerror(error));
+    madvise(data, status.st_size, MADV_WILLNEED); // read ahead, the parsers touch every page
+    m_data = static_cast<const char *>(data);
+    m_size = status.st_size;
+}
+
+void MappedFile::close() {
+    if (m_data)
+        munmap(const_cast<char *>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
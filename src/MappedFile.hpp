@@ -0,0 +1,28 @@
+#pragma once
+
+// USUAL INCLUDES
+#include <cstddef>
+#include <string>
+
+/*
+Read-only memory mapping of a whole file (mmap): the pages are read by the kernel as they are touched, with no copy
+into a user buffer. Throws std::runtime_error("file: reason") when the file cannot be opened or mapped.
+*/
+class MappedFile {
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+
+public:
+    MappedFile() {}
+    explicit MappedFile(const std::string &_filename) { open(_filename); }
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    void open(const std::string &_filename);
+    void close();
+
+    inline bool isOpen() const { return m_data != nullptr; }
+    inline const char *data() const { return m_data; }
+    inline size_t size() const { return m_size; }
+};
@@ -1,7 +1,13 @@
 #pragma once
 
+#ifndef HEADLESS
 // GLEW
 #include <GL/glew.h>
+#endif
+
+#include "MeshTopology.hpp"
+#include "ThreadPool.hpp"
+#include "Transformation.hpp"
 
 // GLM
 #include <glm/glm.hpp>
@@ -19,14 +25,34 @@ private:
     std::vector<glm::vec3> m_normals;
     std::vector<glm::vec2> m_uvs;
     std::vector<glm::uvec3> m_triangles;
+    std::shared_ptr<const MeshTopology> m_topology; // stored with the binary cache, null otherwise
+
+    // Normals (see recomputePerVertexNormals)
+    std::vector<uint> m_corner_offsets;                        // the corners of vertex v are m_vertex_corners[m_corner_offsets[v]; m_corner_offsets[v + 1][
+    std::vector<uint> m_vertex_corners;                        // 4 t + k for the corner k of triangle t, sorted by vertex then triangle
+    std::vector<glm::vec3> m_triangle_normals;                 // (p1 − p0) × (p2 − p0)
+    std::vector<uint> m_touched_triangles, m_touched_vertices; // of the last incremental recomputation
+    std::vector<glm::vec3> m_touched_normals;                  // normals of m_touched_triangles
+    std::vector<uint> m_triangle_marks, m_vertex_marks;        // m_mark: already touched by the current recomputation
+    uint m_mark = 0;
 
-    GLuint m_VAO;
-    GLuint m_positions_VBO;
-    GLuint m_normals_VBO;
-    GLuint m_uvs_VBO;
-    GLuint m_triangles_EBO;
+#ifndef HEADLESS
+    GLuint m_VAO = 0;
+    GLuint m_positions_VBO = 0;
+    GLuint m_normals_VBO = 0;
+    GLuint m_uvs_VBO = 0;
+    GLuint m_triangles_EBO = 0;
+    GLuint m_instances_VBO = 0; // model matrix of every instance
+    uint m_instance_count = 0;
+#endif
 
     void centerAndScaleToUnit();
+    void parseOFF(const std::string &_filename, ThreadPool &_thread_pool);
+    void trianglesChanged(); // drops what is computed from the triangles
+    void buildVertexCorners();
+    glm::vec3 gatherNormal(uint _v, bool _angle_based) const;
+    bool loadCache(const std::string &_filename, const std::string &_source); // false if missing, invalid or outdated
+    void saveCache(const std::string &_filename, const std::string &_source) const;
 
 public:
     virtual ~Mesh();
@@ -34,7 +60,10 @@ public:
     // INITIALIZERS
     Mesh() {}
     Mesh(const std::string &filename) { loadOFF(filename); }
-    void loadOFF(const std::string &filename);
+    // Throws std::runtime_error("file:line: reason"). With a _cache_directory, the binary cache kept there (see the
+    // definition) is read instead of the OFF file when it is up to date, and written after parsing otherwise
+    void loadOFF(const std::string &filename, ThreadPool &_thread_pool = ThreadPool::global(), const std::string &_cache_directory = std::string());
+    static std::string cacheFilename(const std::string &_filename, const std::string &_cache_directory); // ("dir/model.off", "cache") -> "cache/model.mesh"
     void setSingleTriangle();
     void setSimpleGrid(size_t _nx, size_t _nz);                                           // Create a grid where x and z varies in [0;1]
     void setSimpleTerrain(size_t _nx, size_t _nz, glm::vec2 y_range = glm::vec2(0., 1.)); // Create a terrain where x and z varies in [0;1] and y varies in y_range
@@ -50,15 +79,28 @@ public:
     inline std::vector<glm::vec2> &vertexTexCoords() { return m_uvs; }
     inline const std::vector<glm::uvec3> &triangleIndices() const { return m_triangles; }
     inline std::vector<glm::uvec3> &triangleIndices() { return m_triangles; }
+    // Welded topology of a mesh loaded by loadOFF with the cache (null otherwise), valid as long as the triangles and
+    // the equalities between positions are unchanged
+    inline const MeshTopology *topology() const { return m_topology.get(); }
 
     /// Compute the parameters of a sphere which bounds the mesh
     void computeBoundingSphere(glm::vec3 &center, float &radius) const;
 
-    void recomputePerVertexNormals(bool angleBased = false);
+    // Gathers the normals of the triangles around every vertex in parallel (see the definition). With _moved_vertices,
+    // only the normals of the vertices sharing a triangle with a moved vertex are recomputed.
+    void recomputePerVertexNormals(bool angleBased = false, ThreadPool &_thread_pool = ThreadPool::global());
+    void recomputePerVertexNormals(const std::vector<uint> &_moved_vertices, bool angleBased = false, ThreadPool &_thread_pool = ThreadPool::global());
     void recomputePerVertexTextureCoordinates();
 
-    // OpenGL interface
+    // OpenGL interface (left out of HEADLESS builds, except clear)
+#ifndef HEADLESS
     void init();
     void render();
+    // Many copies of the mesh drawn by one call: the model matrix of every instance is read by the vertex shader from
+    // the attributes 3 to 6 (see vertex_instanced.glsl). After init.
+    void setInstances(const std::vector<glm::mat4> &_models);
+    void setInstances(const std::vector<Transformation> &_transformations);
+    void renderInstances();
+#endif
     void clear();
 };
\ No newline at end of file
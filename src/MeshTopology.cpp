@@ -0,0 +1,154 @@
+#include "MeshTopology.hpp"
+#include <algorithm>
+#include <cstdint>
+
+// Number of vertices per bucket of half-edges
+static const uint BUCKET_GRAIN = 256;
+// Number of triangles per parallel task of the bucketing
+static const uint TRIANGLE_GRAIN = 1024;
+
+/*
+Computed in a few passes, every array sized once:
+(1) the vertices at exactly the same position are welded (sorted by position), the welded vertices keep the order of
+    the mesh
+(2) the half-edges (a -> b, opposite vertex c) of the non-degenerate triangles are bucketed by min(a, b) in ranges
+    of BUCKET_GRAIN vertices (parallel counting sort, per-chunk counts combined in chunk order)
+(3) forall buckets (in parallel): sort the half-edges by (min(a, b), max(a, b)) so that the half-edges of an edge are
+    contiguous (counting sort by min(a, b), the half-edges of one vertex are then few enough for an insertion sort),
+    count the edges and the bending pairs (edges shared by exactly two triangles)
+(4) prefix sums over the buckets give the slot of every edge and pair, then forall buckets (in parallel): write them
+The edges and the pairs are sorted by vertex, whatever the number of threads.
+Two half-edges a -> b (opposite c) and b -> a (opposite d) give the triangles (b, c, a) and (b, a, d) sharing the
+edge (b, a): the bending pair is (b, a, c, d).
+*/
+void MeshTopology::build(const std::vector<glm::vec3> &_positions, const std::vector<glm::uvec3> &_triangles, bool _weld, ThreadPool &_thread_pool) {
+    struct HalfEdge {
+        uint a, b, c; // a -> b, c is the opposite vertex of the triangle
+        inline uint64_t key() const { return uint64_t(std::min(a, b)) << 32 | std::max(a, b); }
+    };
+    const uint V = _positions.size();
+
+    // (1)
+    vertex_map.resize(V);
+    vertex_count = V;
+    if (_weld) {
+        std::vector<uint> sorted(V), representatives(V);
+        for (uint i = 0; i < V; i++)
+            sorted[i] = i;
+        std::sort(sorted.begin(), sorted.end(), [&](uint _a, uint _b) {
+            const glm::vec3 &pa = _positions[_a], &pb = _positions[_b];
+            return pa.x < pb.x || (pa.x == pb.x && (pa.y < pb.y || (pa.y == pb.y && (pa.z < pb.z || (pa.z == pb.z && _a < _b)))));
+        });
+        for (uint k = 0; k < V; k++) // the first vertex of a group of equal positions represents the group
+            representatives[sorted[k]] = k > 0 && _positions[sorted[k]] == _positions[sorted[k - 1]] ? representatives[sorted[k - 1]] : sorted[k];
+        vertex_count = 0;
+        for (uint i = 0; i < V; i++)
+            vertex_map[i] = representatives[i] == i ? vertex_count++ : vertex_map[representatives[i]];
+    } else {
+        for (uint i = 0; i < V; i++)
+            vertex_map[i] = i;
+    }
+
+    triangles.clear();
+    triangles.reserve(_triangles.size());
+    for (const glm::uvec3 &mesh_triangle : _triangles) {
+        glm::uvec3 triangle = glm::uvec3(vertex_map[mesh_triangle.x], vertex_map[mesh_triangle.y], vertex_map[mesh_triangle.z]);
+        if (triangle.x != triangle.y && triangle.y != triangle.z && triangle.z != triangle.x) // setCube leaves (0, 0, 0) triangles
+            triangles.push_back(triangle);
+    }
+    const uint T = triangles.size();
+
+    // (2)
+    const uint bucket_count = std::max(ThreadPool::chunkCount(0, vertex_count, BUCKET_GRAIN), 1u);
+    const uint chunk_count = ThreadPool::chunkCount(0, T, TRIANGLE_GRAIN);
+    auto bucket = [&](const HalfEdge &_half_edge) { return std::min(_half_edge.a, _half_edge.b) / BUCKET_GRAIN; };
+    auto halfEdge = [&](uint _t, uint _k) {
+        const glm::uvec3 &triangle = triangles[_t];
+        return HalfEdge{triangle[_k], triangle[(_k + 1) % 3], triangle[(_k + 2) % 3]};
+    };
+    std::vector<uint> cursors(chunk_count * bucket_count, 0); // [chunk][bucket]
+    _thread_pool.parallelForChunks(0, T, TRIANGLE_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        uint *counts = cursors.data() + _chunk * bucket_count;
+        for (uint t = _begin; t < _end; t++)
+            for (uint k = 0; k < 3; k++)
+                counts[bucket(halfEdge(t, k))]++;
+    });
+    std::vector<uint> bucket_offsets(bucket_count + 1, 0);
+    for (uint b = 0; b < bucket_count; b++) {
+        bucket_offsets[b + 1] = bucket_offsets[b];
+        for (uint chunk = 0; chunk < chunk_count; chunk++) {
+            uint count = cursors[chunk * bucket_count + b];
+            cursors[chunk * bucket_count + b] = bucket_offsets[b + 1];
+            bucket_offsets[b + 1] += count;
+        }
+    }
+    std::vector<HalfEdge> bucketed(3 * T), half_edges(3 * T);
+    _thread_pool.parallelForChunks(0, T, TRIANGLE_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        uint *chunk_cursors = cursors.data() + _chunk * bucket_count;
+        for (uint t = _begin; t < _end; t++) {
+            for (uint k = 0; k < 3; k++) {
+                HalfEdge half_edge = halfEdge(t, k);
+                bucketed[chunk_cursors[bucket(half_edge)]++] = half_edge;
+            }
+        }
+    });
+
+    // (3)
+    std::vector<uint> edge_offsets(bucket_count + 1, 0), pair_offsets(bucket_count + 1, 0);
+    auto isPair = [&](uint _begin, uint _end) { return _end - _begin == 2 && half_edges[_begin].c != half_edges[_begin + 1].c; };
+    _thread_pool.parallelFor(0, bucket_count, 1, [&](uint _b) {
+        // counting sort by min(a, b), then insertion sort of the few half-edges of every vertex by max(a, b)
+        const uint bucket_begin = bucket_offsets[_b], bucket_end = bucket_offsets[_b + 1];
+        const uint first_vertex = _b * BUCKET_GRAIN;
+        uint vertex_offsets[BUCKET_GRAIN + 1] = {};
+        for (uint i = bucket_begin; i < bucket_end; i++)
+            vertex_offsets[std::min(bucketed[i].a, bucketed[i].b) - first_vertex + 1]++;
+        for (uint v = 0; v < BUCKET_GRAIN; v++)
+            vertex_offsets[v + 1] += vertex_offsets[v];
+        for (uint i = bucket_begin; i < bucket_end; i++) {
+            uint v = std::min(bucketed[i].a, bucketed[i].b) - first_vertex;
+            half_edges[bucket_begin + vertex_offsets[v]++] = bucketed[i];
+        }
+        for (uint i = bucket_begin + 1; i < bucket_end; i++) {
+            HalfEdge half_edge = half_edges[i];
+            uint j = i;
+            for (; j > bucket_begin && half_edges[j - 1].key() > half_edge.key(); j--)
+                half_edges[j] = half_edges[j - 1];
+            half_edges[j] = half_edge;
+        }
+
+        for (uint i = bucket_begin, j; i < bucket_end; i = j) {
+            for (j = i + 1; j < bucket_end && half_edges[j].key() == half_edges[i].key(); j++)
+                ;
+            edge_offsets[_b + 1]++;
+            pair_offsets[_b + 1] += isPair(i, j);
+        }
+    });
+    for (uint b = 0; b < bucket_count; b++) {
+        edge_offsets[b + 1] += edge_offsets[b];
+        pair_offsets[b + 1] += pair_offsets[b];
+    }
+
+    // (4)
+    edges.resize(edge_offsets[bucket_count]);
+    bending_pairs.resize(pair_offsets[bucket_count]);
+    _thread_pool.parallelFor(0, bucket_count, 1, [&](uint _b) {
+        uint edge = edge_offsets[_b], pair = pair_offsets[_b];
+        for (uint i = bucket_offsets[_b], j; i < bucket_offsets[_b + 1]; i = j) {
+            for (j = i + 1; j < bucket_offsets[_b + 1] && half_edges[j].key() == half_edges[i].key(); j++)
+                ;
+            const HalfEdge &half_edge = half_edges[i];
+            edges[edge++] = glm::uvec2(std::min(half_edge.a, half_edge.b), std::max(half_edge.a, half_edge.b));
+            if (isPair(i, j))
+                bending_pairs[pair++] = glm::uvec4(half_edge.b, half_edge.a, half_edge.c, half_edges[i + 1].c);
+        }
+    });
+}
+
+void MeshTopology::clear() {
+    vertex_count = 0;
+    vertex_map.clear();
+    triangles.clear();
+    edges.clear();
+    bending_pairs.clear();
+}
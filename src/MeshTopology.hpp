@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ThreadPool.hpp"
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <vector>
+
+/*
+Simulation view of a triangle mesh, used by DynamicObject::addMesh: welded vertices, unique edges and bending pairs.
+It only depends on the triangles and on which positions are equal, so it is computed once per mesh (and stored in
+the binary cache of the OFF meshes, see Mesh::loadOFF) whatever the transformation the object is built with.
+*/
+struct MeshTopology {
+    uint vertex_count = 0;                 // after welding
+    std::vector<uint> vertex_map;          // welded vertex of every vertex of the mesh
+    std::vector<glm::uvec3> triangles;     // welded, without the degenerate triangles
+    std::vector<glm::uvec2> edges;         // (min, max), sorted
+    std::vector<glm::uvec4> bending_pairs; // (b, a, c, d) of the edges shared by exactly two triangles, sorted by edge
+
+    void build(const std::vector<glm::vec3> &_positions, const std::vector<glm::uvec3> &_triangles, bool _weld, ThreadPool &_thread_pool = ThreadPool::global());
+    void clear();
+};
@@ -0,0 +1,90 @@
+#include "ObjectBatch.hpp"
+
+bool ObjectBatch::matches(const std::vector<std::unique_ptr<DynamicObject>> &_objects) const {
+    if (m_VAO == 0 || _objects.size() + 1 != m_vertex_offsets.size())
+        return false;
+    for (uint o = 0; o < _objects.size(); o++)
+        if (_objects[o]->vertexCount() != m_vertex_offsets[o + 1] - m_vertex_offsets[o] || _objects[o]->renderedLinesVersion() != m_lines_versions[o])
+            return false;
+    return true;
+}
+
+void ObjectBatch::build(const std::vector<std::unique_ptr<DynamicObject>> &_objects) {
+    if (m_VAO == 0) {
+        glGenVertexArrays(1, &m_VAO);
+        glBindVertexArray(m_VAO);
+        glEnableVertexAttribArray(0);
+        glGenBuffers(1, &m_lines_EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_lines_EBO);
+        glBindVertexArray(0);
+    }
+
+    const uint object_count = _objects.size();
+    m_vertex_offsets.assign(object_count + 1, 0);
+    m_lines_versions.resize(object_count);
+    m_counts.resize(object_count);
+    m_first_indices.resize(object_count);
+    m_base_vertices.assign(object_count, 0);
+    size_t line_count = 0;
+    for (uint o = 0; o < object_count; o++) {
+        const DynamicObject &object = *_objects[o];
+        m_vertex_offsets[o + 1] = m_vertex_offsets[o] + object.vertexCount();
+        m_lines_versions[o] = object.renderedLinesVersion();
+        m_counts[o] = 2 * object.renderedLines().size();
+        m_first_indices[o] = reinterpret_cast<const void *>(line_count * sizeof(glm::uvec2));
+        line_count += object.renderedLines().size();
+    }
+
+    // the lines of every object, in its own numbering (the base vertex of the draw moves them)
+    glBindVertexArray(m_VAO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, line_count * sizeof(glm::uvec2), NULL, GL_STATIC_DRAW);
+    for (uint o = 0; o < object_count; o++) {
+        const std::vector<glm::uvec2> &lines = _objects[o]->renderedLines();
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, reinterpret_cast<GLintptr>(m_first_indices[o]), lines.size() * sizeof(glm::uvec2), lines.data());
+    }
+    glBindVertexArray(0);
+}
+
+// See StreamingBuffer: with the persistent mapping the positions are written where the GPU reads them
+glm::vec3 *ObjectBatch::map() {
+    return vertexCount() > 0 ? static_cast<glm::vec3 *>(m_positions.map(vertexCount() * sizeof(glm::vec3))) : nullptr;
+}
+
+void ObjectBatch::unmap() {
+    m_positions.unmap();
+    const GLint region_vertex = m_positions.offset() / sizeof(glm::vec3);
+    for (uint o = 0; o < m_base_vertices.size(); o++)
+        m_base_vertices[o] = region_vertex + m_vertex_offsets[o];
+    if (m_attribute_generation == m_positions.generation())
+        return;
+    m_attribute_generation = m_positions.generation(); // (re)allocated
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_positions.buffer());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindVertexArray(0);
+}
+
+void ObjectBatch::render() {
+    if (!m_attribute_generation || m_counts.empty()) // nothing uploaded yet
+        return;
+    glBindVertexArray(m_VAO); // Activate the VAO storing geometry data
+    glMultiDrawElementsBaseVertex(GL_LINES, m_counts.data(), GL_UNSIGNED_INT, m_first_indices.data(), m_counts.size(), m_base_vertices.data());
+}
+
+void ObjectBatch::clear() {
+    if (m_VAO) {
+        glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+    }
+    m_positions.clear();
+    m_attribute_generation = 0;
+    if (m_lines_EBO) {
+        glDeleteBuffers(1, &m_lines_EBO);
+        m_lines_EBO = 0;
+    }
+    m_vertex_offsets.clear();
+    m_lines_versions.clear();
+    m_counts.clear();
+    m_first_indices.clear();
+    m_base_vertices.clear();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "DynamicObject.hpp"
+#include "StreamingBuffer.hpp"
+
+// GLEW
+#include <GL/glew.h>
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <memory>
+#include <vector>
+
+/*
+READ "Approaching Zero Driver Overhead" (GDC 2014), "Multi-Draw Indirect".
+The lines of many DynamicObjects drawn together, so that the draw calls scale with the number of materials (one, every
+object is drawn with the same program) instead of the number of objects:
+- one StreamingBuffer holds the positions of every object, concatenated in the order of the objects: a frame is
+  mapped once, every object writes its slice from vertexOffset(o)
+- one element buffer holds the lines of every object, concatenated and kept in the numbering of their object
+- render() binds one VAO and issues one glMultiDrawElementsBaseVertex: draw o reads the lines of object o, its base
+  vertex (first vertex of the current region + vertexOffset(o)) moves them to the slice of the object
+The element buffer is only rebuilt when an object gains vertices or changes its lines (see matches).
+*/
+class ObjectBatch {
+    GLuint m_VAO = 0;
+    StreamingBuffer m_positions;     // xi of every object, concatenated
+    uint m_attribute_generation = 0; // generation of m_positions the position attribute of m_VAO points to, 0 -> none
+    GLuint m_lines_EBO = 0;
+
+    std::vector<uint> m_vertex_offsets;        // the vertices of object o are [m_vertex_offsets[o]; m_vertex_offsets[o + 1][
+    std::vector<uint> m_lines_versions;        // DynamicObject::renderedLinesVersion when the lines were uploaded
+    std::vector<GLsizei> m_counts;             // indices of the lines of every object
+    std::vector<const void *> m_first_indices; // byte offset of the lines of every object in m_lines_EBO
+    std::vector<GLint> m_base_vertices;        // first vertex of every object in the current region
+
+public:
+    ObjectBatch() {}
+    ~ObjectBatch() { clear(); }
+    ObjectBatch(const ObjectBatch &) = delete;
+    ObjectBatch &operator=(const ObjectBatch &) = delete;
+
+    // The vertex counts and the lines uploaded are those of _objects
+    bool matches(const std::vector<std::unique_ptr<DynamicObject>> &_objects) const;
+    void build(const std::vector<std::unique_ptr<DynamicObject>> &_objects); // needs the GL context
+
+    inline uint vertexCount() const { return m_vertex_offsets.empty() ? 0 : m_vertex_offsets.back(); }
+    inline uint vertexOffset(uint _object) const { return m_vertex_offsets[_object]; }
+    // vertexCount() positions written between map and unmap
+    glm::vec3 *map();
+    void unmap();
+
+    void render(); // one draw call
+    void clear();  // needs the GL context
+};
@@ -0,0 +1,346 @@
+#include "PhysicsWorld.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+
+// Special values of m_island_bins
+static const uint LARGE_ISLAND = UINT_MAX;        // stepped alone with the whole thread pool
+static const uint SLEEPING_ISLAND = UINT_MAX - 1; // skipped
+
+DynamicObject &PhysicsWorld::addObject() {
+    m_objects.emplace_back(new DynamicObject());
+    m_objects.back()->setThreadPool(m_thread_pool);
+    m_objects.back()->setSleepsAlone(false); // the world puts whole islands to sleep
+    return *m_objects.back();
+}
+
+void PhysicsWorld::setThreadPool(ThreadPool *_thread_pool) {
+    m_thread_pool = _thread_pool;
+    for (std::unique_ptr<DynamicObject> &object : m_objects)
+        object->setThreadPool(_thread_pool);
+}
+
+uint PhysicsWorld::findRoot(uint _object) {
+    while (m_parents[_object] != _object) {
+        m_parents[_object] = m_parents[m_parents[_object]]; // path halving
+        _object = m_parents[_object];
+    }
+    return _object;
+}
+
+// (2)
+void PhysicsWorld::computeIslands() {
+    const uint K = m_objects.size();
+    m_sweep_order.resize(K);
+    m_parents.resize(K);
+    for (uint o = 0; o < K; o++)
+        m_sweep_order[o] = m_parents[o] = o;
+    std::sort(m_sweep_order.begin(), m_sweep_order.end(), [&](uint _a, uint _b) {
+        return m_object_mins[_a].x < m_object_mins[_b].x || (m_object_mins[_a].x == m_object_mins[_b].x && _a < _b);
+    });
+
+    // sort and sweep: the boxes overlapping a along x start before a ends
+    for (uint a = 0; a < K; a++) {
+        uint oa = m_sweep_order[a];
+        for (uint b = a + 1; b < K; b++) {
+            uint ob = m_sweep_order[b];
+            if (m_object_mins[ob].x > m_object_maxs[oa].x)
+                break;
+            if (m_object_mins[ob].y > m_object_maxs[oa].y || m_object_maxs[ob].y < m_object_mins[oa].y ||
+                m_object_mins[ob].z > m_object_maxs[oa].z || m_object_maxs[ob].z < m_object_mins[oa].z)
+                continue;
+            uint ra = findRoot(oa), rb = findRoot(ob);
+            m_parents[std::max(ra, rb)] = std::min(ra, rb); // the root is the first object of the island
+        }
+    }
+
+    // islands numbered by their first object, then the objects grouped by island (counting sort)
+    m_island_offsets.assign(1, 0);
+    m_object_islands.resize(K);
+    for (uint o = 0; o < K; o++) {
+        uint root = findRoot(o);
+        if (root == o) {
+            m_object_islands[o] = m_island_offsets.size() - 1;
+            m_island_offsets.push_back(0);
+        } else {
+            m_object_islands[o] = m_object_islands[root]; // the root comes first
+        }
+        m_island_offsets[m_object_islands[o] + 1]++;
+    }
+    const uint island_count = m_island_offsets.size() - 1;
+    for (uint k = 0; k < island_count; k++)
+        m_island_offsets[k + 1] += m_island_offsets[k];
+
+    m_island_objects.resize(K);
+    m_island_costs.assign(island_count, 0.f);
+    m_sleeping_islands.assign(island_count, true);
+    m_cursors.assign(m_island_offsets.begin(), m_island_offsets.end() - 1);
+    for (uint o = 0; o < K; o++) {
+        uint island = m_object_islands[o];
+        m_island_objects[m_cursors[island]++] = o;
+        const DynamicObject &object = *m_objects[o];
+        m_island_costs[island] += float(object.vertexCount() + object.constraintCount() + object.triangleCount() + 1);
+        m_sleeping_islands[island] = m_sleeping_islands[island] && object.isSleeping();
+    }
+
+    // an awake object wakes its whole island
+    for (uint o = 0; o < K; o++)
+        if (!m_sleeping_islands[m_object_islands[o]] && m_objects[o]->isSleeping())
+            m_objects[o]->wake();
+}
+
+// (3)
+void PhysicsWorld::scheduleIslands() {
+    const uint island_count = m_island_costs.size();
+    float total_cost = 0.f;
+    for (uint k = 0; k < island_count; k++)
+        if (!m_sleeping_islands[k])
+            total_cost += m_island_costs[k];
+    const uint thread_count = m_thread_pool->threadCount();
+    const float large_cost = thread_count > 1 ? total_cost / thread_count : FLT_MAX;
+
+    m_island_order.resize(island_count);
+    for (uint k = 0; k < island_count; k++)
+        m_island_order[k] = k;
+    std::sort(m_island_order.begin(), m_island_order.end(), [&](uint _a, uint _b) {
+        return m_island_costs[_a] > m_island_costs[_b] || (m_island_costs[_a] == m_island_costs[_b] && _a < _b);
+    });
+
+    // longest processing time first
+    uint small_count = 0;
+    for (uint k : m_island_order)
+        small_count += !m_sleeping_islands[k] && m_island_costs[k] < large_cost;
+    const uint bin_count = std::min(thread_count, small_count);
+    m_bin_costs.assign(bin_count, 0.f);
+    m_island_bins.resize(island_count);
+    m_stats.large_islands = 0;
+    m_stats.sleeping_islands = 0;
+    for (uint k : m_island_order) {
+        if (m_sleeping_islands[k]) {
+            m_island_bins[k] = SLEEPING_ISLAND;
+            m_stats.sleeping_islands++;
+            continue;
+        }
+        if (m_island_costs[k] >= large_cost) {
+            m_island_bins[k] = LARGE_ISLAND;
+            m_stats.large_islands++;
+            continue;
+        }
+        uint lightest = 0;
+        for (uint b = 1; b < bin_count; b++)
+            if (m_bin_costs[b] < m_bin_costs[lightest])
+                lightest = b;
+        m_island_bins[k] = lightest;
+        m_bin_costs[lightest] += m_island_costs[k];
+    }
+
+    // islands grouped by bin, by decreasing cost inside a bin
+    m_bin_offsets.assign(bin_count + 1, 0);
+    for (uint k = 0; k < island_count; k++)
+        if (m_island_bins[k] < bin_count)
+            m_bin_offsets[m_island_bins[k] + 1]++;
+    for (uint b = 0; b < bin_count; b++)
+        m_bin_offsets[b + 1] += m_bin_offsets[b];
+    m_bin_islands.resize(m_bin_offsets[bin_count]);
+    m_cursors.assign(m_bin_offsets.begin(), m_bin_offsets.end() - 1);
+    for (uint k : m_island_order)
+        if (m_island_bins[k] < bin_count)
+            m_bin_islands[m_cursors[m_island_bins[k]]++] = k;
+
+    m_stats.islands = island_count;
+    m_stats.bins = bin_count;
+}
+
+/*
+Contacts between the objects of an island, solved after their update. The vertices move from xi - ∆t vi to xi
+during the step ((12)-(15) of the update): the swept boxes of the vertices of all the objects are hashed together,
+every pair of vertices of two different objects which come closer than h during the step (see
+ParticleContactConstraints::timeOfImpact) gives C = (pa - pb) . n - h >= 0, with n the direction at the impact.
+The contacts are projected contact_iterations times (Gauss-Seidel), the correction ∆x of every vertex is applied
+to xi and vi. The surfaces of two objects collide through their vertices only.
+*/
+uint PhysicsWorld::solveContacts(uint _island, float _delta_time, ContactWorkspace &_workspace) {
+    PROFILE_SCOPE("contacts");
+    const float h = m_settings.contact_thickness, stiffness = m_settings.contact_stiffness;
+    ContactWorkspace &ws = _workspace;
+    ws.starts.clear();
+    ws.positions.clear();
+    ws.mins.clear();
+    ws.maxs.clear();
+    ws.vertices.clear();
+    ws.weights.clear();
+    for (uint k = m_island_offsets[_island]; k < m_island_offsets[_island + 1]; k++) {
+        uint o = m_island_objects[k];
+        const DynamicObject &object = *m_objects[o];
+        for (uint i = 0; i < object.vertexCount(); i++) {
+            glm::vec3 x = object.position(i), start = x - _delta_time * object.velocity(i);
+            ws.starts.push_back(start);
+            ws.positions.push_back(x);
+            ws.mins.push_back(glm::min(start, x));
+            ws.maxs.push_back(glm::max(start, x));
+            ws.vertices.push_back(glm::uvec2(o, i));
+            ws.weights.push_back(object.inverseMass(i));
+        }
+    }
+    const uint count = ws.positions.size();
+    float largest_sweep = 0.f;
+    for (uint a = 0; a < count; a++) {
+        glm::vec3 extent = ws.maxs[a] - ws.mins[a];
+        largest_sweep = std::max(largest_sweep, std::max(std::max(extent.x, extent.y), extent.z));
+    }
+    ws.spatial_hash.build(ws.mins.data(), ws.maxs.data(), count, std::max(h, 0.25f * largest_sweep), *m_thread_pool);
+
+    ws.contacts.clear();
+    for (uint a = 0; a < count; a++) {
+        ws.spatial_hash.forEachInBox(ws.mins[a] - h, ws.maxs[a] + h, [&](uint _b) {
+            if (_b <= a || ws.vertices[a].x == ws.vertices[_b].x || ws.weights[a] + ws.weights[_b] == 0.f)
+                return;
+            glm::vec3 d0 = ws.starts[a] - ws.starts[_b], d1 = ws.positions[a] - ws.positions[_b];
+            float t;
+            if (!ParticleContactConstraints::timeOfImpact(d0, d1, h, t))
+                return;
+            glm::vec3 d = d0 + t * (d1 - d0);
+            float length = glm::length(d);
+            if (length > 1e-12f)
+                ws.contacts.push_back({glm::uvec2(a, _b), d / length});
+        });
+    }
+    if (ws.contacts.empty())
+        return 0;
+
+    for (uint iteration = 0; iteration < m_settings.contact_iterations; iteration++) {
+        for (const Contact &contact : ws.contacts) {
+            glm::vec3 &pa = ws.positions[contact.vertices.x], &pb = ws.positions[contact.vertices.y];
+            float wa = ws.weights[contact.vertices.x], wb = ws.weights[contact.vertices.y];
+            float c = glm::dot(pa - pb, contact.normal) - h;
+            if (c >= 0.f)
+                continue;
+            float s = stiffness * c / (wa + wb);
+            pa -= s * wa * contact.normal;
+            pb += s * wb * contact.normal;
+        }
+    }
+
+    for (uint a = 0; a < count; a++) {
+        DynamicObject &object = *m_objects[ws.vertices[a].x];
+        glm::vec3 delta = ws.positions[a] - object.position(ws.vertices[a].y);
+        if (delta != glm::vec3(0.f))
+            object.correctVertex(ws.vertices[a].y, delta, _delta_time);
+    }
+    return ws.contacts.size();
+}
+
+void PhysicsWorld::stepIsland(uint _island, float _delta_time, ContactWorkspace &_workspace, uint &_contacts) {
+    const uint begin = m_island_offsets[_island], end = m_island_offsets[_island + 1];
+    for (uint k = begin; k < end; k++)
+        m_objects[m_island_objects[k]]->update(_delta_time);
+    if (end - begin > 1) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        _contacts += solveContacts(_island, _delta_time, _workspace);
+        _workspace.contact_time += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // the rest is measured after the contacts, which hold a stack still
+    bool resting = true;
+    for (uint k = begin; k < end; k++)
+        resting &= m_objects[m_island_objects[k]]->updateResting();
+    if (resting)
+        for (uint k = begin; k < end; k++)
+            m_objects[m_island_objects[k]]->sleep();
+}
+
+const WorldStats &PhysicsWorld::update(float _delta_time) {
+    m_stats = WorldStats();
+    const uint K = m_objects.size();
+    if (K == 0)
+        return m_stats;
+
+    PROFILE_SCOPE("PhysicsWorld::update");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // (1) the gravity may add ∆t² |g| to the motion of a vertex during the step
+    const float margin = m_settings.contact_thickness + _delta_time * _delta_time * glm::length(GRAVITY);
+    m_object_mins.resize(K);
+    m_object_maxs.resize(K);
+    m_thread_pool->parallelFor(0, K, 1, [&](uint _o) {
+        m_objects[_o]->sweptBounds(_delta_time, m_object_mins[_o], m_object_maxs[_o]);
+        m_object_mins[_o] -= glm::vec3(margin);
+        m_object_maxs[_o] += glm::vec3(margin);
+    });
+
+    // (2) and (3)
+    {
+        PROFILE_SCOPE("(2)-(3) islands");
+        computeIslands();
+        scheduleIslands();
+    }
+    m_stats.island_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+    // (4) the large islands one after the other, then the bins in parallel
+    const uint bin_count = m_stats.bins;
+    if (m_workspaces.size() < std::max(bin_count, 1u))
+        m_workspaces.resize(std::max(bin_count, 1u));
+    m_bin_contacts.assign(bin_count, 0);
+    for (ContactWorkspace &workspace : m_workspaces)
+        workspace.contact_time = 0.f;
+    for (uint k : m_island_order)
+        if (m_island_bins[k] == SLEEPING_ISLAND)
+            for (uint i = m_island_offsets[k]; i < m_island_offsets[k + 1]; i++)
+                m_objects[m_island_objects[i]]->update(_delta_time); // asleep: only resets the stats of the object
+    for (uint k : m_island_order)
+        if (m_island_bins[k] == LARGE_ISLAND)
+            stepIsland(k, _delta_time, m_workspaces[0], m_stats.contacts);
+    m_thread_pool->parallelForChunks(0, bin_count, 1, [&](uint _bin, uint, uint) {
+        PROFILE_SCOPE("(4) bin");
+        for (uint b = m_bin_offsets[_bin]; b < m_bin_offsets[_bin + 1]; b++)
+            stepIsland(m_bin_islands[b], _delta_time, m_workspaces[_bin], m_bin_contacts[_bin]);
+    });
+    for (uint contacts : m_bin_contacts)
+        m_stats.contacts += contacts;
+    for (const ContactWorkspace &workspace : m_workspaces)
+        m_stats.contact_time += workspace.contact_time;
+    return m_stats;
+}
+
+#ifndef HEADLESS
+void PhysicsWorld::initRendering() {
+    for (std::unique_ptr<DynamicObject> &object : m_objects) {
+        object->reserveWorkspace();
+        object->updateRenderedConstraints();
+    }
+    m_batch.build(m_objects);
+    updateRenderedPositions();
+}
+
+// The frame holds every object: once an object moved, the sleeping ones are copied too
+void PhysicsWorld::updateRenderedPositions() {
+    bool dirty = false;
+    for (std::unique_ptr<DynamicObject> &object : m_objects)
+        dirty |= object->takeRenderedPositionsDirty();
+    if (!m_batch.matches(m_objects)) {
+        m_batch.build(m_objects);
+        dirty = true;
+    }
+    if (!dirty)
+        return; // all asleep, the uploaded positions are up to date
+    if (glm::vec3 *positions = m_batch.map()) {
+        for (uint o = 0; o < m_objects.size(); o++)
+            m_objects[o]->packPositions(positions + m_batch.vertexOffset(o));
+        m_batch.unmap();
+    }
+}
+
+void PhysicsWorld::render() {
+    m_batch.render();
+}
+#endif
+
+void PhysicsWorld::clear() {
+    for (std::unique_ptr<DynamicObject> &object : m_objects)
+        object->clear();
+    m_objects.clear();
+#ifndef HEADLESS
+    m_batch.clear();
+#endif
+}
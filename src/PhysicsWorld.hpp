@@ -0,0 +1,128 @@
+#pragma once
+
+#include "DynamicObject.hpp"
+#include "SpatialHash.hpp"
+#include "ThreadPool.hpp"
+#ifndef HEADLESS
+#include "ObjectBatch.hpp"
+#endif
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <memory>
+#include <vector>
+
+struct WorldSettings {
+    float contact_thickness = 0.02f; // h: distance kept between the vertices of two different objects
+    float contact_stiffness = 1.f;   // kj of the contacts between objects (PBD)
+    uint contact_iterations = 4;     // Gauss-Seidel iterations over the contacts between objects
+};
+
+// Reported by PhysicsWorld::update
+struct WorldStats {
+    uint islands = 0;          // groups of objects which may touch each other during the step
+    uint large_islands = 0;    // islands stepped alone with the whole thread pool
+    uint bins = 0;             // groups of small islands stepped in parallel
+    uint contacts = 0;         // contacts between objects, summed over the islands
+    uint sleeping_islands = 0; // islands skipped, every object asleep
+    float island_time = 0.f;   // seconds spent in (1)-(3)
+    float contact_time = 0.f;  // seconds spent solving the contacts between objects, summed over the bins
+};
+
+/*
+Owns many DynamicObjects and steps them together:
+(1) forall objects do compute the box swept by the vertices during the step (grown by h)
+(2) islands: the objects whose boxes overlap may touch (sort and sweep along x), they are merged with a union-find.
+    The constraints never link two objects, so an island is a set of objects in contact.
+(3) an island with a cost (vertices + constraints + triangles) of at least 1 / threads of the total is large:
+    it is stepped alone, its objects using the whole thread pool. The small islands are packed in one bin per thread
+    by "longest processing time first" (the next largest island goes to the least loaded bin).
+(4) forall bins (in parallel) do forall islands of the bin do
+        forall objects of the island do update(∆t) (the parallel loops of the objects run serially inside a bin)
+        solve the contacts between the vertices of different objects (see solveContacts)
+        the island sleeps if all its objects rest (see DynamicObject::updateResting)
+The islands, bins and contacts do not depend on the number of threads, only their execution does.
+Sleeping is decided per island: an island whose objects all sleep is skipped (its objects only report sleeping
+SolverStats), an island which also holds an awake object (e.g. a body falling onto a sleeping stack) wakes all its
+objects.
+*/
+class PhysicsWorld {
+    // Vertices of the objects of an island hashed together, one workspace per bin
+    struct Contact {
+        glm::uvec2 vertices; // pair of hashed vertices
+        glm::vec3 normal;    // direction from the second to the first one at the time of impact
+    };
+    struct ContactWorkspace {
+        SpatialHash spatial_hash;
+        std::vector<glm::vec3> starts;    // xi - ∆t vi: position at the start of the step
+        std::vector<glm::vec3> positions; // xi
+        std::vector<glm::vec3> mins;      // swept box of every vertex during the step
+        std::vector<glm::vec3> maxs;      //
+        std::vector<glm::uvec2> vertices; // (object, vertex) of every hashed vertex
+        std::vector<float> weights;       // wi of every hashed vertex
+        std::vector<Contact> contacts;
+        float contact_time = 0.f; // of the current update
+    };
+
+    std::vector<std::unique_ptr<DynamicObject>> m_objects;
+    WorldSettings m_settings;
+    WorldStats m_stats;
+    ThreadPool *m_thread_pool = &ThreadPool::global();
+
+    // (1)-(3), reused from one step to the next
+    std::vector<glm::vec3> m_object_mins, m_object_maxs;
+    std::vector<uint> m_sweep_order;       // objects by increasing min.x
+    std::vector<uint> m_parents;           // union-find forest of the objects
+    std::vector<uint> m_object_islands;    // island of every object
+    std::vector<bool> m_sleeping_islands;  // every object of the island sleeps
+    std::vector<uint> m_cursors;           // counting sorts
+    std::vector<uint> m_island_offsets;    // CSR: the objects of island k are m_island_objects[m_island_offsets[k]; m_island_offsets[k + 1][
+    std::vector<uint> m_island_objects;    //
+    std::vector<float> m_island_costs;     //
+    std::vector<uint> m_island_order;      // islands by decreasing cost
+    std::vector<uint> m_bin_offsets;       // CSR: the islands of bin b are m_bin_islands[m_bin_offsets[b]; m_bin_offsets[b + 1][
+    std::vector<uint> m_bin_islands;       //
+    std::vector<uint> m_island_bins;       // bin of every small island, LARGE_ISLAND or SLEEPING_ISLAND otherwise
+    std::vector<float> m_bin_costs;        //
+    std::vector<uint> m_bin_contacts;      // contacts solved by every bin
+    std::vector<ContactWorkspace> m_workspaces;
+
+#ifndef HEADLESS
+    ObjectBatch m_batch; // every object drawn by one call
+#endif
+
+    uint findRoot(uint _object);
+    void computeIslands();
+    void scheduleIslands();
+    void stepIsland(uint _island, float _delta_time, ContactWorkspace &_workspace, uint &_contacts);
+    uint solveContacts(uint _island, float _delta_time, ContactWorkspace &_workspace);
+
+public:
+    DynamicObject &addObject(); // the object uses the thread pool of the world
+    inline uint objectCount() const { return m_objects.size(); }
+    inline DynamicObject &object(uint _i) { return *m_objects[_i]; }
+    inline const DynamicObject &object(uint _i) const { return *m_objects[_i]; }
+
+    inline const WorldSettings &settings() const { return m_settings; }
+    inline WorldSettings &settings() { return m_settings; }
+    inline const WorldStats &stats() const { return m_stats; } // of the last update
+    void setThreadPool(ThreadPool *_thread_pool);
+
+    const WorldStats &update(float _delta_time);
+
+    // OpenGL interface, the objects are drawn together by an ObjectBatch (left out of HEADLESS builds, except clear)
+#ifndef HEADLESS
+    void initRendering();
+    void updateRenderedPositions(); // rebuilds the batch if an object gained vertices or changed its lines
+    // Positions computed elsewhere (e.g. interpolated) written between map and unmap: renderedVertexCount() positions,
+    // those of object o from renderedVertexOffset(o). Only touches the buffer.
+    inline glm::vec3 *mapRenderedPositions() { return m_batch.map(); }
+    inline void unmapRenderedPositions() { m_batch.unmap(); }
+    inline uint renderedVertexCount() const { return m_batch.vertexCount(); }
+    inline uint renderedVertexOffset(uint _object) const { return m_batch.vertexOffset(_object); }
+    void render();
+#endif
+    void clear();
+};
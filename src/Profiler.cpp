@@ -0,0 +1,179 @@
+#include "Profiler.hpp"
+
+#ifndef HEADLESS
+#include <imgui.h>
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+
+static thread_local void *t_ring = nullptr; // ThreadRing of the calling thread in the global profiler
+
+static std::string jsonString(const char *_string) {
+    std::string escaped = "\"";
+    for (; *_string; _string++) {
+        if (*_string == '"' || *_string == '\\')
+            escaped += '\\';
+        escaped += *_string;
+    }
+    return escaped + "\"";
+}
+
+Profiler &Profiler::global() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::ThreadRing &Profiler::threadRing() {
+    if (!t_ring) {
+        std::lock_guard<std::mutex> lock(m_rings_mutex);
+        m_rings.emplace_back(new ThreadRing());
+        m_rings.back()->index = m_rings.size() - 1;
+        m_rings.back()->name = "thread " + std::to_string(m_rings.size() - 1);
+        t_ring = m_rings.back().get();
+    }
+    return *static_cast<ThreadRing *>(t_ring);
+}
+
+void Profiler::setThreadName(const std::string &_name) {
+    ThreadRing &ring = threadRing();
+    std::lock_guard<std::mutex> lock(m_rings_mutex); // read by writeChromeTrace
+    ring.name = _name;
+}
+
+void Profiler::record(const char *_name, int64_t _begin, int64_t _end) {
+    ThreadRing &ring = threadRing();
+    if (ring.events.empty())
+        ring.events.resize(RING_CAPACITY); // published with the first head
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % RING_CAPACITY] = ProfileEvent{_name, _begin, _end};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+// The writer is overwriting event head_after - RING_CAPACITY at most: the events before it may be torn
+uint64_t Profiler::copyEvents(const ThreadRing &_ring, uint64_t _first, std::vector<ProfileEvent> &_events) {
+    const uint64_t head = _ring.head.load(std::memory_order_acquire);
+    _first = std::max(_first, head > RING_CAPACITY ? head - RING_CAPACITY : 0);
+    const size_t size = _events.size();
+    for (uint64_t i = _first; i < head; i++)
+        _events.push_back(_ring.events[i % RING_CAPACITY]);
+    const uint64_t head_after = _ring.head.load(std::memory_order_acquire);
+    const uint64_t valid = head_after >= RING_CAPACITY ? head_after - RING_CAPACITY + 1 : 0;
+    if (valid > _first) {
+        uint64_t lapped = std::min(valid, head) - _first;
+        _events.erase(_events.begin() + size, _events.begin() + size + lapped);
+    }
+    return head;
+}
+
+/*
+(1) the time since the previous frame goes to the frame graph
+(2) forall rings do copy the events ended since the previous frame, sum their durations per name (a nested scope is
+    also counted in its parent: the rows are not meant to be stacked)
+*/
+void Profiler::frame() {
+    const int64_t now = this->now();
+    const uint slot = m_frame % FRAME_HISTORY;
+    m_frame_times[slot] = isEnabled() ? (now - m_frame_start) * 1e-6f : 0.f; // (1)
+    m_frame_start = now;
+    for (ScopeHistory &scope : m_scopes)
+        scope.times[slot] = 0.f;
+    m_frame++;
+
+    // (2)
+    m_events.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_rings_mutex);
+        for (std::unique_ptr<ThreadRing> &ring : m_rings)
+            ring->collected = copyEvents(*ring, ring->collected, m_events);
+    }
+    ScopeHistory *last = nullptr; // consecutive events often share their name
+    for (const ProfileEvent &event : m_events) {
+        if (!last || (last->name != event.name && strcmp(last->name, event.name) != 0)) {
+            auto it = std::find_if(m_scopes.begin(), m_scopes.end(), [&](const ScopeHistory &_scope) {
+                return _scope.name == event.name || strcmp(_scope.name, event.name) == 0;
+            });
+            if (it == m_scopes.end()) {
+                m_scopes.push_back(ScopeHistory{event.name});
+                it = m_scopes.end() - 1;
+            }
+            last = &*it;
+        }
+        last->times[slot] += (event.end - event.begin) * 1e-6f;
+    }
+}
+
+// Complete events ("ph": "X") in µs, one tid per ring, named by a metadata event
+bool Profiler::writeChromeTrace(const std::string &_filename) {
+    FILE *output = fopen(_filename.c_str(), "w");
+    if (!output)
+        return false;
+    fprintf(output, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    std::vector<ProfileEvent> events;
+    std::lock_guard<std::mutex> lock(m_rings_mutex);
+    for (const std::unique_ptr<ThreadRing> &ring : m_rings) {
+        fprintf(output, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": {\"name\": %s}}", first ? "" : ",\n", ring->index, jsonString(ring->name.c_str()).c_str());
+        first = false;
+        events.clear();
+        copyEvents(*ring, 0, events);
+        for (const ProfileEvent &event : events)
+            fprintf(output, ",\n{\"name\": %s, \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %u}", jsonString(event.name).c_str(), event.begin * 1e-3, (event.end - event.begin) * 1e-3, ring->index);
+    }
+    fprintf(output, "\n]}\n");
+    bool written = !ferror(output);
+    return fclose(output) == 0 && written;
+}
+
+#ifndef HEADLESS
+void Profiler::drawWindow() {
+    ImGui::SetNextWindowPos(ImVec2(420.f, 60.f), ImGuiCond_FirstUseEver); // right of the "Camera Interface"
+    if (ImGui::Begin("Profiler")) {
+        bool enabled = isEnabled();
+        if (ImGui::Checkbox("Enabled", &enabled))
+            setEnabled(enabled);
+
+        const uint offset = m_frame % FRAME_HISTORY; // oldest frame first
+        const uint frames = std::max(std::min(m_frame, FRAME_HISTORY), 1u);
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "%.2f ms", m_frame_times[(m_frame + FRAME_HISTORY - 1) % FRAME_HISTORY]);
+        ImGui::PlotLines("Frame", m_frame_times, FRAME_HISTORY, offset, overlay, 0.f, FLT_MAX, ImVec2(0.f, 60.f));
+
+        if (ImGui::BeginTable("Scopes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("Mean (ms)");
+            ImGui::TableSetupColumn("Max (ms)");
+            ImGui::TableSetupColumn("Last frames");
+            ImGui::TableHeadersRow();
+            for (const ScopeHistory &scope : m_scopes) {
+                float sum = 0.f, max = 0.f;
+                for (uint f = 0; f < FRAME_HISTORY; f++) {
+                    sum += scope.times[f];
+                    max = std::max(max, scope.times[f]);
+                }
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(scope.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", sum / frames);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", max);
+                ImGui::TableNextColumn();
+                ImGui::PushID(scope.name);
+                ImGui::PlotLines("##times", scope.times, FRAME_HISTORY, offset, NULL, 0.f, FLT_MAX, ImVec2(-FLT_MIN, 20.f));
+                ImGui::PopID();
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::InputText("File", m_trace_filename, sizeof(m_trace_filename));
+        if (ImGui::Button("Export Chrome trace"))
+            m_trace_status = writeChromeTrace(m_trace_filename) ? std::string("written to ") + m_trace_filename : std::string("cannot write ") + m_trace_filename;
+        if (!m_trace_status.empty())
+            ImGui::TextUnformatted(m_trace_status.c_str());
+    }
+    ImGui::End();
+}
+#endif
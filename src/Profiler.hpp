@@ -0,0 +1,103 @@
+#pragma once
+
+// USUAL INCLUDES
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Interval timed by a ProfileScope
+struct ProfileEvent {
+    const char *name; // string literal
+    int64_t begin;    // ns since the start of the profiler
+    int64_t end;      //
+};
+
+/*
+READ "Trace Event Format" (Chromium) for the export.
+Lightweight instrumentation of the numbered phases of the solver, of the world and of the rendering:
+- PROFILE_SCOPE("name") times the enclosing scope with steady_clock. While the profiler is disabled it costs one
+  relaxed atomic load.
+- every thread writes its events to its own ring of RING_CAPACITY events, registered (under a mutex) at its first
+  event: recording never locks nor waits, the oldest events are overwritten
+- the render thread calls frame() once per frame: the events ended since the previous frame are collected from every
+  ring and their durations summed per name into a rolling history of FRAME_HISTORY frames (see drawWindow)
+- writeChromeTrace exports the events still held by the rings (chrome://tracing, ui.perfetto.dev)
+A reader copies the events then reads the head of the ring again: the events the writer may have overwritten in the
+meantime (lapped) are dropped instead of reported torn.
+*/
+class Profiler {
+public:
+    static const uint RING_CAPACITY = 1u << 16; // events per thread
+    static const uint FRAME_HISTORY = 240;      // frames shown by drawWindow
+
+private:
+    struct ThreadRing {
+        std::vector<ProfileEvent> events; // RING_CAPACITY, allocated at the first event
+        std::atomic<uint64_t> head{0};    // events written since start, event i is events[i % RING_CAPACITY]
+        uint64_t collected = 0;           // events already summed by frame()
+        uint index = 0;                   // tid in the trace
+        std::string name;
+    };
+    struct ScopeHistory {
+        const char *name;
+        float times[FRAME_HISTORY] = {}; // ms per frame, summed over the threads
+    };
+
+    std::atomic<bool> m_enabled{false};
+    const std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+    std::mutex m_rings_mutex;                // registration and readers only
+    std::vector<std::unique_ptr<ThreadRing>> m_rings;
+
+    // Render thread
+    std::vector<ScopeHistory> m_scopes;
+    std::vector<ProfileEvent> m_events;      // collected by the last frame
+    float m_frame_times[FRAME_HISTORY] = {}; // ms
+    uint m_frame = 0;                        // frames since start, m_frame % FRAME_HISTORY is the oldest one
+    int64_t m_frame_start = 0;
+    char m_trace_filename[256] = "trace.json";
+    std::string m_trace_status;
+
+    Profiler() {}
+    ThreadRing &threadRing(); // of the calling thread
+    // Events [first; head[ of the ring still valid after the copy, appended to _events
+    static uint64_t copyEvents(const ThreadRing &_ring, uint64_t _first, std::vector<ProfileEvent> &_events);
+
+public:
+    static Profiler &global();
+
+    inline bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    inline void setEnabled(bool _enabled) { m_enabled.store(_enabled, std::memory_order_relaxed); }
+    void setThreadName(const std::string &_name); // of the calling thread in the trace ("thread k" by default)
+    inline int64_t now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count(); }
+    void record(const char *_name, int64_t _begin, int64_t _end); // lock-free, into the ring of the calling thread
+
+    void frame();                                        // render thread, once per frame
+    bool writeChromeTrace(const std::string &_filename); // false if the file cannot be written
+#ifndef HEADLESS
+    void drawWindow(); // ImGui: frame graph, time per scope, export
+#endif
+};
+
+class ProfileScope {
+    const char *m_name;
+    int64_t m_begin; // -1 while the profiler is disabled
+
+public:
+    explicit ProfileScope(const char *_name) : m_name(_name), m_begin(Profiler::global().isEnabled() ? Profiler::global().now() : -1) {}
+    ~ProfileScope() {
+        if (m_begin >= 0)
+            Profiler::global().record(m_name, m_begin, Profiler::global().now());
+    }
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+#define PROFILE_CONCATENATE_(_a, _b) _a##_b
+#define PROFILE_CONCATENATE(_a, _b) PROFILE_CONCATENATE_(_a, _b)
+// Times the enclosing scope, _name must be a string literal
+#define PROFILE_SCOPE(_name) ProfileScope PROFILE_CONCATENATE(profile_scope_, __LINE__)(_name)
@@ -0,0 +1,201 @@
+#include "Scenario.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+void buildCloth(DynamicObject &_object, const glm::vec3 &_origin, uint _nx, uint _nz, float _spacing, bool _pinned) {
+    for (uint z = 0; z < _nz; z++)
+        for (uint x = 0; x < _nx; x++)
+            _object.addVertex(_origin + _spacing * glm::vec3(x, 0.f, z), glm::vec3(0.f), 1.f, _pinned && z == 0 && (x == 0 || x == _nx - 1));
+    for (uint z = 0; z < _nz; z++) {
+        for (uint x = 0; x < _nx; x++) {
+            uint i = z * _nx + x;
+            if (x + 1 < _nx)
+                _object.addDistanceConstraint(i, i + 1, 1.f);
+            if (z + 1 < _nz)
+                _object.addDistanceConstraint(i, i + _nx, 1.f);
+            if (x + 1 < _nx && z + 1 < _nz) {
+                // quad split along (i, i + nx + 1): triangles (i, i + nx, i + nx + 1) and (i, i + nx + 1, i + 1)
+                _object.addDistanceConstraint(i, i + _nx + 1, 1.f);
+                _object.addBendingConstraint(i, i + _nx + 1, i + 1, i + _nx, 1.f);
+                _object.addTriangle(i, i + _nx, i + _nx + 1);
+                _object.addTriangle(i, i + _nx + 1, i + 1);
+            }
+        }
+    }
+}
+
+void buildBlock(DynamicObject &_object, const glm::vec3 &_origin, const glm::uvec3 &_n, float _spacing, float _cluster_size) {
+    for (uint z = 0; z < _n.z; z++)
+        for (uint y = 0; y < _n.y; y++)
+            for (uint x = 0; x < _n.x; x++)
+                _object.addVertex(_origin + _spacing * glm::vec3(x, y, z), glm::vec3(0.f), 1.f, false);
+    if (_cluster_size > 0.f) {
+        _object.addShapeMatchingClusters(_cluster_size, 1.f);
+        return;
+    }
+    for (uint z = 0; z < _n.z; z++) {
+        for (uint y = 0; y < _n.y; y++) {
+            for (uint x = 0; x < _n.x; x++) {
+                uint i = (z * _n.y + y) * _n.x + x;
+                for (uint k = 1; k < 8; k++) {
+                    glm::uvec3 neighbour = glm::uvec3(x + (k & 1), y + ((k >> 1) & 1), z + ((k >> 2) & 1));
+                    if (glm::any(glm::greaterThanEqual(neighbour, _n)))
+                        continue;
+                    _object.addDistanceConstraint(i, (neighbour.z * _n.y + neighbour.y) * _n.x + neighbour.x, 1.f);
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+void Scenario::load(const std::string &_filename, PhysicsWorld &_world) {
+    ifstream in(_filename.c_str());
+    if (!in)
+        throw runtime_error(_filename + ": cannot open the scenario");
+    size_t slash = _filename.find_last_of('/');
+    name = slash == string::npos ? _filename : _filename.substr(slash + 1);
+
+    SolverSettings solver_settings; // of the next objects
+    bool reorder = false;
+    VertexOrder order = MORTON_ORDER;
+    vector<uint> reordered_objects; // built while a reorder command was active, with their order
+    vector<VertexOrder> orders;     //
+    string mesh_cache_directory;    // empty -> the OFF meshes are parsed at every load
+
+    string line;
+    for (uint line_number = 1; getline(in, line); line_number++) {
+        line = line.substr(0, line.find('#'));
+        istringstream command_line(line);
+        string command;
+        if (!(command_line >> command))
+            continue;
+        auto fail = [&](const string &_reason) {
+            throw runtime_error(_filename + ":" + to_string(line_number) + ": " + _reason);
+        };
+
+        bool valid = true;
+        if (command == "steps") {
+            valid = bool(command_line >> steps);
+        } else if (command == "time_step") {
+            valid = command_line >> time_step && time_step > 0.f;
+        } else if (command == "threads") {
+            valid = bool(command_line >> threads);
+        } else if (command == "contact_thickness") {
+            valid = bool(command_line >> _world.settings().contact_thickness);
+        } else if (command == "contact_iterations") {
+            valid = bool(command_line >> _world.settings().contact_iterations);
+        } else if (command == "solver") {
+            string mode;
+            command_line >> mode;
+            if (mode == "gauss_seidel")
+                solver_settings.mode = GAUSS_SEIDEL;
+            else if (mode == "colored_gauss_seidel")
+                solver_settings.mode = COLORED_GAUSS_SEIDEL;
+            else if (mode == "jacobi")
+                solver_settings.mode = JACOBI;
+            else
+                fail("unknown solver \"" + mode + "\"");
+        } else if (command == "max_iterations") {
+            valid = bool(command_line >> solver_settings.max_iterations);
+        } else if (command == "xpbd") {
+            valid = bool(command_line >> solver_settings.substeps >> solver_settings.xpbd_iterations);
+            solver_settings.use_xpbd = solver_settings.substeps > 0;
+        } else if (command == "self_collisions") {
+            valid = bool(command_line >> solver_settings.self_collisions);
+        } else if (command == "sleep") {
+            valid = bool(command_line >> solver_settings.sleep_energy >> solver_settings.sleep_frames);
+        } else if (command == "reorder") {
+            string mode;
+            command_line >> mode;
+            reorder = mode != "none";
+            if (mode == "morton")
+                order = MORTON_ORDER;
+            else if (mode == "rcm")
+                order = CUTHILL_MCKEE_ORDER;
+            else if (reorder)
+                fail("unknown vertex order \"" + mode + "\"");
+        } else if (command == "mesh_cache") {
+            valid = bool(command_line >> mesh_cache_directory);
+        } else if (command == "ground") {
+            float y, half_size;
+            valid = command_line >> y >> half_size && half_size > 0.f;
+            if (valid) {
+                m_meshes.emplace_back(new Mesh());
+                m_meshes.back()->setSimpleGrid(2, 2);
+                glm::mat4 model = glm::translate(glm::mat4(1.f), glm::vec3(-half_size, y, -half_size));
+                model = glm::scale(model, glm::vec3(2.f * half_size, 1.f, 2.f * half_size));
+                m_colliders.emplace_back(new StaticBVH());
+                m_colliders.back()->build(*m_meshes.back(), model);
+            }
+        } else if (command == "cloth") {
+            glm::vec3 origin;
+            uint nx, nz;
+            float spacing;
+            string pinned;
+            valid = command_line >> origin.x >> origin.y >> origin.z >> nx >> nz >> spacing && nx > 1 && nz > 1 && spacing > 0.f;
+            if (valid) {
+                command_line >> pinned;
+                if (!pinned.empty() && pinned != "pinned")
+                    fail("expected \"pinned\", got \"" + pinned + "\"");
+                DynamicObject &object = _world.addObject();
+                object.solverSettings() = solver_settings;
+                buildCloth(object, origin, nx, nz, spacing, pinned == "pinned");
+            }
+        } else if (command == "block") {
+            glm::vec3 origin;
+            glm::uvec3 n;
+            float spacing, cluster_size = 0.f;
+            valid = command_line >> origin.x >> origin.y >> origin.z >> n.x >> n.y >> n.z >> spacing && glm::all(glm::greaterThan(n, glm::uvec3(0))) && spacing > 0.f;
+            if (valid) {
+                command_line >> cluster_size;
+                DynamicObject &object = _world.addObject();
+                object.solverSettings() = solver_settings;
+                buildBlock(object, origin, n, spacing, cluster_size);
+            }
+        } else if (command == "mesh" || command == "cube_sphere") {
+            Mesh mesh;
+            string path;
+            uint n = 0;
+            glm::vec3 origin;
+            float scale;
+            MeshBuildSettings mesh_settings;
+            if (command == "mesh")
+                valid = bool(command_line >> path);
+            valid = valid && command_line >> origin.x >> origin.y >> origin.z >> scale && scale > 0.f;
+            if (command == "cube_sphere")
+                valid = valid && command_line >> n && n > 1;
+            if (valid) {
+                command_line >> mesh_settings.volume_stiffness;
+                if (command == "mesh")
+                    mesh.loadOFF(path, ThreadPool::global(), mesh_cache_directory); // throws "file.off:line: reason"
+                else
+                    mesh.setCubeSphere(n);
+                DynamicObject &object = _world.addObject();
+                object.solverSettings() = solver_settings;
+                object.addMesh(mesh, mesh_settings, glm::scale(glm::translate(glm::mat4(1.f), origin), glm::vec3(scale)));
+            }
+        } else {
+            fail("unknown command \"" + command + "\"");
+        }
+        if (!valid)
+            fail("invalid arguments for \"" + command + "\"");
+
+        if (reorder && (command == "cloth" || command == "block" || command == "mesh" || command == "cube_sphere")) {
+            reordered_objects.push_back(_world.objectCount() - 1);
+            orders.push_back(order);
+        }
+    }
+
+    for (uint k = 0; k < reordered_objects.size(); k++)
+        _world.object(reordered_objects[k]).reorderVertices(orders[k]);
+    for (uint o = 0; o < _world.objectCount(); o++)
+        for (const unique_ptr<StaticBVH> &collider : m_colliders)
+            _world.object(o).addCollider(collider.get());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "BVH.hpp"
+#include "PhysicsWorld.hpp"
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+Text description of a PhysicsWorld and of how long to run it, read by the headless runner (see
+./ressources/scenarios/). One command per line, '#' starts a comment:
+    steps <count>                                   steps run (600)
+    time_step <seconds>                             ∆t (1 / 60)
+    threads <count>                                 0 -> hardware concurrency (0)
+    contact_thickness <h>                           WorldSettings
+    contact_iterations <count>                      WorldSettings
+    solver <gauss_seidel|colored_gauss_seidel|jacobi>
+    max_iterations <count>
+    xpbd <substeps> <iterations>                    XPBD, αj derived from kj, "xpbd 0 0" goes back to PBD
+    self_collisions <0|1>
+    sleep <energy> <frames>
+    reorder <none|morton|rcm>                       locality pass run on the objects once built
+    mesh_cache <directory>                          binary cache of the next OFF meshes (see Mesh::loadOFF), none by default
+    ground <y> <half size>                          static square collider, centered on the y axis
+    cloth <x> <y> <z> <nx> <nz> <spacing> [pinned]  grid in the xz plane: distance constraints along the edges and
+                                                    diagonals, bending across the diagonals, triangles for the self
+                                                    collisions. pinned fixes the two corners of the first row
+    block <x> <y> <z> <nx> <ny> <nz> <spacing> [cluster size]
+                                                    lattice of vertices: distance constraints to the 7 forward
+                                                    neighbours, or shape matching clusters of that size
+    mesh <file.off> <x> <y> <z> <scale> [volume stiffness]
+    cube_sphere <x> <y> <z> <radius> <n> [volume stiffness]
+                                                    soft body built by DynamicObject::addMesh (the OFF meshes are
+                                                    centered and scaled to a unit radius by Mesh::loadOFF)
+The solver commands apply to the objects added after them, so one scenario can mix solvers.
+*/
+class Scenario {
+    std::vector<std::unique_ptr<Mesh>> m_meshes; // of the colliders
+    std::vector<std::unique_ptr<StaticBVH>> m_colliders;
+
+public:
+    std::string name; // file name without the directories
+    uint steps = 600;
+    float time_step = 1.f / 60.f;
+    uint threads = 0;
+
+    // Adds the objects described by the file to _world, throws std::runtime_error("file:line: reason") on a
+    // malformed command. The colliders belong to the scenario, which must outlive the world.
+    void load(const std::string &_filename, PhysicsWorld &_world);
+};
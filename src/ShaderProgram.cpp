@@ -1,20 +1,83 @@
 #include "ShaderProgram.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
 #include <exception>
 #include <ios>
+#include <sys/stat.h>
 
 using namespace std;
 
+// Program binary cache file: header then the binary returned by glGetProgramBinary
+static const char PROGRAM_FILE_MAGIC[8] = "HAIPROG";
+static const uint32_t PROGRAM_FILE_VERSION = 1;
+
+namespace {
+
+struct ProgramFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format; // binary format of the driver
+    uint64_t key;    // ShaderProgram::m_binary_key
+    uint64_t length; // bytes of the binary
+};
+
+// FNV-1a of a string, continued from _hash
+uint64_t hashString(const string &_string, uint64_t _hash) {
+    for (char c : _string)
+        _hash = (_hash ^ uint8_t(c)) * 1099511628211ull;
+    return (_hash ^ 0xffu) * 1099511628211ull; // separator, ("ab", "c") and ("a", "bc") differ
+}
+
+string glString(GLenum _name) {
+    const GLubyte *value = glGetString(_name);
+    return value ? string((const char *)value) : string();
+}
+
+// "dir/vertex.glsl" -> "vertex"
+string stem(const string &_filename) {
+    size_t slash = _filename.find_last_of('/');
+    string name = slash == string::npos ? _filename : _filename.substr(slash + 1);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+} // namespace
+
 ShaderProgram::ShaderProgram() : m_id(glCreateProgram()) {}
 
-ShaderProgram::ShaderProgram(const string &vertexShaderFilename, const string &fragmentShaderFilename) : m_id(glCreateProgram()) {
-    loadShader(GL_VERTEX_SHADER, vertexShaderFilename);
-    loadShader(GL_FRAGMENT_SHADER, fragmentShaderFilename);
-    link();
+/*
+(1) the program binary is keyed by the two sources and by the driver (vendor, renderer, version): editing a shader or
+    updating the driver recompiles it
+(2) the binary saved by the last launch is given back to the driver, which may still refuse it (link status false)
+(3) otherwise the shaders are compiled and linked, and link() saves the binary for the next launch
+Nothing is read nor written without a cache directory.
+*/
+ShaderProgram::ShaderProgram(const string &vertexShaderFilename, const string &fragmentShaderFilename, const string &_cache_directory) : m_id(glCreateProgram()) {
+    string vertex_source = file2String(vertexShaderFilename);
+    string fragment_source = file2String(fragmentShaderFilename);
+
+    // (1)
+    if (!_cache_directory.empty() && programBinarySupported()) {
+        m_cache_directory = _cache_directory;
+        m_binary_filename = _cache_directory + "/" + stem(vertexShaderFilename) + "+" + stem(fragmentShaderFilename) + ".program";
+        m_binary_key = 14695981039346656037ull;
+        for (const string &part : {vertex_source, fragment_source, glString(GL_VENDOR), glString(GL_RENDERER), glString(GL_VERSION)})
+            m_binary_key = hashString(part, m_binary_key);
+    }
+
+    // (2)
+    if (loadBinary()) {
+        resolveUniforms();
+    } else { // (3)
+        compileShader(GL_VERTEX_SHADER, vertex_source, vertexShaderFilename);
+        compileShader(GL_FRAGMENT_SHADER, fragment_source, fragmentShaderFilename);
+        link();
+    }
     use();
 }
 
@@ -22,6 +85,14 @@ ShaderProgram::~ShaderProgram() {
     glDeleteProgram(m_id);
 }
 
+bool ShaderProgram::programBinarySupported() {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    return format_count > 0;
+}
+
 string ShaderProgram::file2String(const string &filename) {
     ifstream input(filename.c_str());
     if (!input)
@@ -31,14 +102,12 @@ string ShaderProgram::file2String(const string &filename) {
     return buffer.str();
 }
 
-void ShaderProgram::loadShader(GLenum type, const string &shaderFilename) {
-    GLuint shader = glCreateShader(type);                    // Create the shader, e.g., a vertex shader to be applied to every single vertex of a mesh
-    string shaderSourceString = file2String(shaderFilename); // Loads the shader source from a file to a C++ string
+void ShaderProgram::compileShader(GLenum type, const string &shaderSourceString, const string &shaderFilename) {
     if (shaderSourceString.empty()) {
         cerr << "No content in shader " << shaderFilename << endl;
-        glDeleteShader(shader);
         return;
     }
+    GLuint shader = glCreateShader(type);                                    // Create the shader, e.g., a vertex shader to be applied to every single vertex of a mesh
     const GLchar *shaderSource = (const GLchar *)shaderSourceString.c_str(); // Interface the C++ string through a C pointer
     glShaderSource(shader, 1, &shaderSource, NULL);                          // Load the vertex shader source code
     glCompileShader(shader);                                                 // THe GPU driver compile the shader
@@ -57,4 +126,145 @@ void ShaderProgram::loadShader(GLenum type, const string &shaderFilename) {
     }
     glAttachShader(m_id, shader); // Set the vertex shader as the one ot be used with the program/pipeline
     glDeleteShader(shader);
+}
+
+void ShaderProgram::link() {
+    GLint attached_shaders = 0;
+    glGetProgramiv(m_id, GL_ATTACHED_SHADERS, &attached_shaders);
+    if (attached_shaders == 0) // loaded from the program binary, already linked
+        return;
+    if (!m_binary_filename.empty())
+        glProgramParameteri(m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(m_id);
+    GLint linked;
+    glGetProgramiv(m_id, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLsizei len;
+        glGetProgramiv(m_id, GL_INFO_LOG_LENGTH, &len);
+        GLchar *log = new GLchar[len + 1];
+        glGetProgramInfoLog(m_id, len, &len, log);
+        cerr << "Link error in program " << m_id << " : " << endl
+             << log << endl;
+        delete[] log;
+        return;
+    }
+    resolveUniforms();
+    saveBinary();
+}
+
+/*
+Every active uniform is stored once as (nameHash(name), location), sorted by hash: getLocation is then a binary search
+instead of a glGetUniformLocation (a string lookup in the driver) per uniform, per object, per frame. An array is
+stored as "name[0]" by the driver, it is also registered as "name". The hashes of the few uniforms of a program do not
+collide in practice, a collision would be reported here.
+*/
+void ShaderProgram::resolveUniforms() {
+    m_locations.clear();
+    GLint uniform_count = 0, max_length = 0;
+    glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    vector<GLchar> name(max_length + 1);
+    for (GLint u = 0; u < uniform_count; u++) {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(m_id, u, max_length + 1, &length, &size, &type, name.data());
+        GLint location = glGetUniformLocation(m_id, name.data());
+        if (location < 0) // member of a uniform block
+            continue;
+        m_locations.emplace_back(nameHash(name.data()), location);
+        if (length > 3 && strcmp(name.data() + length - 3, "[0]") == 0) {
+            name[length - 3] = '\0';
+            m_locations.emplace_back(nameHash(name.data()), location);
+        }
+    }
+    sort(m_locations.begin(), m_locations.end());
+    for (size_t i = 1; i < m_locations.size(); i++)
+        if (m_locations[i].first == m_locations[i - 1].first)
+            cerr << "Uniform name hash collision in program " << m_id << endl;
+
+    GLuint frame_block = glGetUniformBlockIndex(m_id, "Frame");
+    if (frame_block != GL_INVALID_INDEX)
+        glUniformBlockBinding(m_id, frame_block, FRAME_UNIFORMS_BINDING);
+}
+
+GLint ShaderProgram::getLocation(const string &name) const {
+    uint64_t hash = nameHash(name.c_str());
+    auto it = lower_bound(m_locations.begin(), m_locations.end(), make_pair(hash, GLint(-1)));
+    return it != m_locations.end() && it->first == hash ? it->second : -1;
+}
+
+bool ShaderProgram::loadBinary() {
+    if (m_binary_filename.empty())
+        return false;
+    ifstream input(m_binary_filename.c_str(), ios::binary);
+    ProgramFileHeader header;
+    if (!input || !input.read((char *)&header, sizeof(header)))
+        return false;
+    if (memcmp(header.magic, PROGRAM_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != PROGRAM_FILE_VERSION || header.key != m_binary_key || header.length == 0)
+        return false;
+    vector<char> binary(header.length);
+    if (!input.read(binary.data(), binary.size()))
+        return false;
+    glProgramBinary(m_id, header.format, binary.data(), binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(m_id, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+// Written to a temporary file then renamed, so that a concurrent launch never reads half a binary
+void ShaderProgram::saveBinary() const {
+    if (m_binary_filename.empty())
+        return;
+    GLint length = 0;
+    glGetProgramiv(m_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    ProgramFileHeader header = {};
+    memcpy(header.magic, PROGRAM_FILE_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_FILE_VERSION;
+    header.key = m_binary_key;
+    vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(m_id, length, &written, &format, binary.data());
+    if (written <= 0)
+        return;
+    header.format = format;
+    header.length = written;
+
+    for (size_t slash = m_cache_directory.find('/', 1); slash != string::npos; slash = m_cache_directory.find('/', slash + 1))
+        mkdir(m_cache_directory.substr(0, slash).c_str(), 0755); // fails harmlessly when it exists
+    mkdir(m_cache_directory.c_str(), 0755);
+    string temporary = m_binary_filename + ".tmp";
+    {
+        ofstream output(temporary.c_str(), ios::binary | ios::trunc);
+        if (!output)
+            return; // directory which cannot be written: compiled again at the next launch
+        output.write((const char *)&header, sizeof(header));
+        output.write(binary.data(), written);
+        if (!output) {
+            output.close();
+            remove(temporary.c_str());
+            return;
+        }
+    }
+    if (rename(temporary.c_str(), m_binary_filename.c_str()) != 0)
+        remove(temporary.c_str());
+}
+
+void FrameUniformBuffer::update(const FrameUniforms &_uniforms) {
+    if (m_buffer == 0) {
+        glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, m_buffer); // also binds GL_UNIFORM_BUFFER
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &_uniforms);
+}
+
+void FrameUniformBuffer::clear() {
+    if (m_buffer != 0)
+        glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
 }
\ No newline at end of file
@@ -3,19 +3,33 @@
 #include <GL/glew.h>
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+// Binding point of the "Frame" uniform block of the shaders (see FrameUniformBuffer)
+static const GLuint FRAME_UNIFORMS_BINDING = 0;
 
 class ShaderProgram {
 private:
     GLuint m_id = 0;
+    std::vector<std::pair<uint64_t, GLint>> m_locations; // (nameHash(name), location) of the active uniforms, sorted
+    std::string m_cache_directory;                       // of the program binary, empty -> no cache
+    std::string m_binary_filename;                       // program binary cache, empty without a cache directory or when the driver has none
+    uint64_t m_binary_key = 0;                           // hash of the sources and of the driver
 
-    std::string file2String(const std::string &filename);            // Loads the content of an ASCII file in a standard C++ string
-    void loadShader(GLenum type, const std::string &shaderFilename); // Loads and compile a shader, before attaching it to a program
+    std::string file2String(const std::string &filename);                                          // Loads the content of an ASCII file in a standard C++ string
+    void compileShader(GLenum type, const std::string &source, const std::string &shaderFilename); // Compiles a shader, before attaching it to a program
+    bool loadBinary();                                                                             // false if missing, outdated or refused by the driver
+    void saveBinary() const;
+    void resolveUniforms();                                                                        // locations of the active uniforms, binding of the "Frame" block
 
 public:
     ShaderProgram();
-    ShaderProgram(const std::string &vertexShaderFilename, const std::string &fragmentShaderFilename);
+    // With a _cache_directory (created on demand), the program binary is kept there from one launch to the next
+    ShaderProgram(const std::string &vertexShaderFilename, const std::string &fragmentShaderFilename, const std::string &_cache_directory = std::string());
     virtual ~ShaderProgram();
 
     /// Generate a minimal shader program, made of one vertex shader and one fragment shader
@@ -23,33 +37,55 @@ public:
 
     inline GLuint id() { return m_id; }
 
-    inline void link() { glLinkProgram(m_id); }
+    void link(); // resolves the uniform locations and the uniform blocks, saves the program binary
     inline void use() { glUseProgram(m_id); }
     inline static void stop() { glUseProgram(0); }
+    static bool programBinarySupported(); // needs the GL context
 
     // UNIFORMS
-    inline GLuint getLocation(const std::string &name) {
-        return glGetUniformLocation(m_id, name.c_str());
+    // FNV-1a: the locations are looked up by the hash of the name, no GL call nor string comparison
+    static inline uint64_t nameHash(const char *_name) {
+        uint64_t hash = 14695981039346656037ull;
+        for (; *_name; _name++)
+            hash = (hash ^ uint8_t(*_name)) * 1099511628211ull;
+        return hash;
     }
+    GLint getLocation(const std::string &name) const; // -1 when the uniform is not active (ignored by glUniform*)
     inline void set(const std::string &name, int value) {
-        glUniform1i(getLocation(name.c_str()), value);
+        glUniform1i(getLocation(name), value);
     }
     inline void set(const std::string &name, GLuint value) {
-        glUniform1i(getLocation(name.c_str()), value);
+        glUniform1i(getLocation(name), value);
     }
     inline void set(const std::string &name, float value) {
-        glUniform1f(getLocation(name.c_str()), value);
+        glUniform1f(getLocation(name), value);
     }
     inline void set(const std::string &name, const glm::vec2 &value) {
-        glUniform2fv(getLocation(name.c_str()), 1, glm::value_ptr(value));
+        glUniform2fv(getLocation(name), 1, glm::value_ptr(value));
     }
     inline void set(const std::string &name, const glm::vec3 &value) {
-        glUniform3fv(getLocation(name.c_str()), 1, glm::value_ptr(value));
+        glUniform3fv(getLocation(name), 1, glm::value_ptr(value));
     }
     inline void set(const std::string &name, const glm::vec4 &value) {
-        glUniform4fv(getLocation(name.c_str()), 1, glm::value_ptr(value));
+        glUniform4fv(getLocation(name), 1, glm::value_ptr(value));
     }
     inline void set(const std::string &name, const glm::mat4 &value) {
-        glUniformMatrix4fv(getLocation(name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        glUniformMatrix4fv(getLocation(name), 1, GL_FALSE, glm::value_ptr(value));
     }
+};
+
+// Uniforms shared by every program, std140 layout of the "Frame" block of the shaders
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+};
+
+// Uniform buffer of FrameUniforms bound to FRAME_UNIFORMS_BINDING: written once per frame instead of once per program
+class FrameUniformBuffer {
+    GLuint m_buffer = 0;
+
+public:
+    ~FrameUniformBuffer() { clear(); }
+    void update(const FrameUniforms &_uniforms); // creates the buffer at the first call
+    void clear();
 };
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "SimulationThread.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+
+SimulationThread::SimulationThread(PhysicsWorld &_world, float _time_step, uint _max_steps)
+    : m_world(_world), m_time_step(_time_step), m_max_steps(std::max(_max_steps, 1u)) {}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+double SimulationThread::time() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void SimulationThread::start() {
+    if (isRunning())
+        return;
+
+    m_object_offsets.assign(1, 0);
+    for (uint o = 0; o < m_world.objectCount(); o++)
+        m_object_offsets.push_back(m_object_offsets.back() + m_world.object(o).vertexCount());
+    m_positions.resize(m_object_offsets.back());
+    m_sleeping.assign(m_world.objectCount(), 0);
+    for (uint o = 0; o < m_world.objectCount(); o++)
+        m_world.object(o).packPositions(m_positions.data() + m_object_offsets[o]);
+    m_uploaded_sleeping.assign(m_world.objectCount(), 0);
+    m_steps = 0;
+    m_published_time = 0.;
+
+    // initial state, published twice so that both sides hold a complete snapshot
+    m_start = std::chrono::steady_clock::now();
+    publish(0., WorldStats());
+    publish(0., WorldStats());
+
+    m_stop = false;
+    m_thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    if (!isRunning())
+        return;
+    m_stop = true;
+    m_thread.join();
+}
+
+void SimulationThread::publish(double _time, const WorldStats &_stats) {
+    WorldSnapshot &snapshot = m_snapshots.back();
+    snapshot.previous_time = m_published_time;
+    snapshot.time = m_published_time = _time;
+    snapshot.previous_positions = m_positions; // same size from one step to the next: no allocation
+    snapshot.sleeping.resize(m_world.objectCount());
+    for (uint o = 0; o < m_world.objectCount(); o++) {
+        const DynamicObject &object = m_world.object(o);
+        bool sleeping = object.isSleeping();
+        if (!(sleeping && m_sleeping[o]))
+            object.packPositions(m_positions.data() + m_object_offsets[o]);
+        snapshot.sleeping[o] = sleeping && m_sleeping[o];
+        m_sleeping[o] = sleeping;
+    }
+    snapshot.positions = m_positions;
+    snapshot.steps = m_steps;
+    snapshot.stats = _stats;
+    m_snapshots.publish();
+}
+
+void SimulationThread::run() {
+    typedef std::chrono::steady_clock clock;
+    const double time_step = m_time_step;
+    double accumulator = 0.;
+    double simulated_time = 0.; // sum of the steps
+    double clock_offset = 0.;   // wall clock time dropped (pauses, steps the simulation could not keep up with)
+    clock::time_point last = clock::now();
+    Profiler::global().setThreadName("simulation");
+    while (!m_stop) {
+        // (1)
+        clock::time_point now = clock::now();
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+        if (m_paused) {
+            clock_offset += elapsed;
+        } else {
+            accumulator += elapsed;
+            if (accumulator > m_max_steps * time_step) {
+                clock_offset += accumulator - m_max_steps * time_step;
+                accumulator = m_max_steps * time_step;
+            }
+        }
+
+        // (2)
+        while (accumulator >= time_step && !m_stop) {
+            WorldStats stats = m_world.update(m_time_step);
+            accumulator -= time_step;
+            simulated_time += time_step;
+            m_steps++;
+            PROFILE_SCOPE("publish");
+            publish(simulated_time + clock_offset, stats);
+        }
+
+        // (3)
+        std::this_thread::sleep_until(last + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(time_step - accumulator)));
+    }
+}
+
+const WorldSnapshot &SimulationThread::updateRenderedPositions() {
+    m_snapshots.acquire();
+    const WorldSnapshot &snapshot = m_snapshots.front();
+    if (m_object_offsets.empty() || snapshot.positions.size() != m_object_offsets.back())
+        return snapshot; // not started
+
+    // the state due one step ago lies between the two states of the newest snapshot
+    double render_time = time() - m_time_step;
+    double interval = snapshot.time - snapshot.previous_time;
+    float alpha = interval > 0. ? float(glm::clamp((render_time - snapshot.previous_time) / interval, 0., 1.)) : 1.f;
+    bool uploaded = true;
+    for (uint o = 0; o + 1 < m_object_offsets.size(); o++)
+        uploaded = uploaded && snapshot.sleeping[o] && m_uploaded_sleeping[o];
+    if (uploaded || m_world.renderedVertexCount() != snapshot.positions.size())
+        return snapshot; // all asleep, or the batch is not built
+    glm::vec3 *positions = m_world.mapRenderedPositions(); // interpolated straight into the buffer, same order as the snapshot
+    if (!positions)
+        return snapshot;
+    for (uint o = 0; o + 1 < m_object_offsets.size(); o++) {
+        if (snapshot.sleeping[o]) // both states are equal
+            std::copy(snapshot.positions.begin() + m_object_offsets[o], snapshot.positions.begin() + m_object_offsets[o + 1], positions + m_object_offsets[o]);
+        else
+            for (uint i = m_object_offsets[o]; i < m_object_offsets[o + 1]; i++)
+                positions[i] = glm::mix(snapshot.previous_positions[i], snapshot.positions[i], alpha);
+        m_uploaded_sleeping[o] = snapshot.sleeping[o];
+    }
+    m_world.unmapRenderedPositions();
+    return snapshot;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "PhysicsWorld.hpp"
+#include "TripleBuffer.hpp"
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// State of the world published by the simulation thread after every step
+struct WorldSnapshot {
+    double time = 0.;                          // wall clock time (seconds since start) at which the state is due
+    double previous_time = 0.;                 // same for the state of the previous step
+    std::vector<glm::vec3> positions;          // xi of every object, concatenated in the order of the objects
+    std::vector<glm::vec3> previous_positions; // xi at the previous step
+    std::vector<uint8_t> sleeping;             // the object slept at both steps: both states are equal
+    uint steps = 0;                            // steps done since start
+    WorldStats stats;                          // of the last step
+};
+
+/*
+READ "Fix Your Timestep!" (Fiedler 2004).
+Steps a PhysicsWorld with a fixed ∆t on a dedicated thread, so that the simulation cost and the VSync of the
+rendering no longer stall each other:
+(1) accumulator += wall clock time elapsed since the last loop (at most max_steps ∆t: a simulation which cannot
+    keep up slows down instead of spiraling, the time dropped shifts the clock of the snapshots)
+(2) while accumulator >= ∆t do world.update(∆t), accumulator -= ∆t, publish a snapshot
+(3) sleep until the next step is due
+The snapshots go through a triple buffer: neither thread ever waits for the other, the renderer reads the newest
+complete snapshot. It draws the world one step in the past, interpolated between the two states of the snapshot,
+so the motion stays smooth whatever the simulation and render rates.
+While the thread runs the world belongs to it: the render thread only uses its ObjectBatch.
+*/
+class SimulationThread {
+    PhysicsWorld &m_world;
+    const float m_time_step; // ∆t
+    const uint m_max_steps;  // per loop
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_paused{false};
+    std::chrono::steady_clock::time_point m_start;
+
+    // Simulation thread
+    TripleBuffer<WorldSnapshot> m_snapshots;
+    std::vector<uint> m_object_offsets; // first position of every object in the snapshots
+    std::vector<glm::vec3> m_positions; // last published positions
+    std::vector<uint8_t> m_sleeping;    // the object slept at the last published step
+    double m_published_time = 0.;       // time of the last published snapshot
+    uint m_steps = 0;
+
+    // Render thread
+    std::vector<uint8_t> m_uploaded_sleeping; // the positions of a sleeping object were already uploaded (skipped if all were)
+
+    void run();
+    void publish(double _time, const WorldStats &_stats);
+
+public:
+    explicit SimulationThread(PhysicsWorld &_world, float _time_step = 1.f / 60.f, uint _max_steps = 4);
+    ~SimulationThread(); // stops the thread
+
+    void start(); // the objects of the world must be added before
+    void stop();
+    inline bool isRunning() const { return m_thread.joinable(); }
+    inline void setPaused(bool _paused) { m_paused = _paused; }
+    inline float timeStep() const { return m_time_step; }
+    double time() const; // wall clock seconds since start
+
+    // Render thread: interpolates the newest snapshot at time() - ∆t into the mapped position buffer of the world
+    // (nothing when every object sleeps and was already uploaded). Returns the snapshot used.
+    const WorldSnapshot &updateRenderedPositions();
+};
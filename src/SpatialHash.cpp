@@ -0,0 +1,97 @@
+#include "SpatialHash.hpp"
+#include <algorithm>
+
+// Number of items (or buckets) per parallel task
+static const uint HASH_GRAIN = 8192;
+
+void SpatialHash::build(const glm::vec3 *_mins, const glm::vec3 *_maxs, uint _count, float _cell_size, ThreadPool &_thread_pool) {
+    m_cell_size = _cell_size;
+    m_inv_cell_size = 1.f / _cell_size;
+
+    // at least twice as many buckets as items to keep the buckets short
+    uint bucket_count = 1;
+    while (bucket_count < 2 * _count)
+        bucket_count *= 2;
+    m_bucket_count = bucket_count;
+
+    m_item_min_cells.resize(_count);
+    m_item_max_cells.resize(_count);
+    m_bucket_offsets.resize(bucket_count + 1);
+    m_chunk_sums.resize(ThreadPool::chunkCount(0, bucket_count, HASH_GRAIN) + 1);
+    if (m_counter_capacity < bucket_count) {
+        m_counters.reset(new std::atomic<uint>[bucket_count]);
+        m_counter_capacity = bucket_count;
+    }
+    std::atomic<uint> *counters = m_counters.get();
+
+    _thread_pool.parallelFor(0, bucket_count, HASH_GRAIN, [&](uint _b) {
+        counters[_b].store(0, std::memory_order_relaxed);
+    });
+
+    // calls _f(cell) for every cell of the item _i
+    auto forEachCell = [&](uint _i, auto &&_f) {
+        const glm::ivec3 &min_cell = m_item_min_cells[_i], &max_cell = m_item_max_cells[_i];
+        if (min_cell == max_cell) { // points and small boxes
+            _f(min_cell);
+            return;
+        }
+        glm::ivec3 cell;
+        for (cell.x = min_cell.x; cell.x <= max_cell.x; cell.x++)
+            for (cell.y = min_cell.y; cell.y <= max_cell.y; cell.y++)
+                for (cell.z = min_cell.z; cell.z <= max_cell.z; cell.z++)
+                    _f(cell);
+    };
+
+    // (1)
+    _thread_pool.parallelFor(0, _count, HASH_GRAIN, [&](uint _i) {
+        m_item_min_cells[_i] = cellOf(_mins[_i]);
+        m_item_max_cells[_i] = cellOf(_maxs[_i]);
+        forEachCell(_i, [&](const glm::ivec3 &_cell) { counters[bucketOf(_cell)].fetch_add(1, std::memory_order_relaxed); });
+    });
+
+    // (2) sum every chunk of buckets, scan the chunk sums, then scan inside the chunks
+    uint *offsets = m_bucket_offsets.data();
+    uint *chunk_sums = m_chunk_sums.data();
+    _thread_pool.parallelForChunks(0, bucket_count, HASH_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        uint sum = 0;
+        for (uint b = _begin; b < _end; b++)
+            sum += counters[b].load(std::memory_order_relaxed);
+        chunk_sums[_chunk + 1] = sum;
+    });
+    chunk_sums[0] = 0;
+    for (uint chunk = 1; chunk < m_chunk_sums.size(); chunk++)
+        chunk_sums[chunk] += chunk_sums[chunk - 1];
+    _thread_pool.parallelForChunks(0, bucket_count, HASH_GRAIN, [&](uint _chunk, uint _begin, uint _end) {
+        uint offset = chunk_sums[_chunk];
+        for (uint b = _begin; b < _end; b++) {
+            offsets[b] = offset;
+            offset += counters[b].load(std::memory_order_relaxed);
+            counters[b].store(offsets[b], std::memory_order_relaxed); // the counters become the scatter cursors
+        }
+    });
+    uint entry_count = chunk_sums[m_chunk_sums.size() - 1];
+    offsets[bucket_count] = entry_count;
+    m_entries.resize(entry_count);
+
+    // (3) the cells of an item are scattered in order by a single thread
+    _thread_pool.parallelFor(0, _count, HASH_GRAIN, [&](uint _i) {
+        forEachCell(_i, [&](const glm::ivec3 &_cell) {
+            const glm::ivec3 &min_cell = m_item_min_cells[_i];
+            Entry &entry = m_entries[counters[bucketOf(_cell)].fetch_add(1, std::memory_order_relaxed)];
+            entry.cell = _cell;
+            entry.item = _i;
+            entry.axes = (_cell.x != min_cell.x) | (_cell.y != min_cell.y) << 1 | (_cell.z != min_cell.z) << 2;
+        });
+    });
+
+    // (4) buckets are short, an insertion sort is enough (stable: the cells of an item stay in order)
+    _thread_pool.parallelFor(0, bucket_count, HASH_GRAIN, [&](uint _b) {
+        for (uint e = offsets[_b] + 1; e < offsets[_b + 1]; e++) {
+            Entry entry = m_entries[e];
+            uint f = e;
+            for (; f > offsets[_b] && m_entries[f - 1].item > entry.item; f--)
+                m_entries[f] = m_entries[f - 1];
+            m_entries[f] = entry;
+        }
+    });
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "ThreadPool.hpp"
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/*
+Uniform grid of cubic cells stored in a hash table (READ "Optimized Spatial Hashing for Collision Detection of
+Deformable Objects", Teschner 2003). The items are points or boxes (e.g. the swept box of a vertex during a step),
+a box is inserted in every cell it overlaps. The table is rebuilt from scratch with a parallel counting sort:
+(1) forall items i do compute the cells and their buckets, count the buckets
+(2) prefix sum of the counts -> first entry of every bucket
+(3) forall items i do scatter i into the buckets of its cells
+(4) forall buckets do sort the entries (the scatter order depends on the threads, the sorted one does not)
+Nothing is allocated once the table has reached its size.
+Different cells may share a bucket, the queries only report the items which are really in the requested cells.
+*/
+class SpatialHash {
+    // An item in one of its cells, 16 bytes
+    struct Entry {
+        glm::ivec3 cell; // stored so that a bucket is scanned contiguously
+        uint item : 29;
+        uint axes : 3; // bit a set: the cell is not the first cell of the item along the axis a
+    };
+
+    float m_cell_size = 1.f;
+    float m_inv_cell_size = 1.f;
+    uint m_bucket_count = 0; // power of two
+
+    std::vector<glm::ivec3> m_item_min_cells; // first cell of every item
+    std::vector<glm::ivec3> m_item_max_cells; // last cell of every item
+    std::vector<uint> m_bucket_offsets;       // the entries of bucket b are m_entries[m_bucket_offsets[b]; m_bucket_offsets[b + 1][
+    std::vector<Entry> m_entries;             // sorted by bucket, then by item
+    std::vector<uint> m_chunk_sums;           // partial sums of the parallel prefix sum
+    std::unique_ptr<std::atomic<uint>[]> m_counters;
+    uint m_counter_capacity = 0;
+
+public:
+    // Hashes the boxes (at most 2^29 items) [_mins[i]; _maxs[i]], i in [0; _count[, in cells of size _cell_size.
+    // A box is stored once per cell it overlaps: _cell_size should not be much smaller than the boxes.
+    void build(const glm::vec3 *_mins, const glm::vec3 *_maxs, uint _count, float _cell_size, ThreadPool &_thread_pool);
+    // Bytes held by the arrays, which keep their capacity from one build to the next
+    inline size_t capacity() const {
+        return (m_item_min_cells.capacity() + m_item_max_cells.capacity()) * sizeof(glm::ivec3) + (m_bucket_offsets.capacity() + m_chunk_sums.capacity()) * sizeof(uint) +
+               m_entries.capacity() * sizeof(Entry) + m_counter_capacity * sizeof(std::atomic<uint>);
+    }
+    // Hashes the points _points[0; _count[ in cells of size _cell_size
+    inline void build(const glm::vec3 *_points, uint _count, float _cell_size, ThreadPool &_thread_pool) {
+        build(_points, _points, _count, _cell_size, _thread_pool);
+    }
+
+    inline float cellSize() const { return m_cell_size; }
+    inline glm::ivec3 cellOf(const glm::vec3 &_point) const { return glm::ivec3(glm::floor(_point * m_inv_cell_size)); }
+    inline uint bucketOf(const glm::ivec3 &_cell) const {
+        return (uint(_cell.x) * 73856093u ^ uint(_cell.y) * 19349663u ^ uint(_cell.z) * 83492791u) & (m_bucket_count - 1);
+    }
+
+    // _f(uint _item) for every item overlapping _cell, in increasing order
+    template <class F>
+    inline void forEachInCell(const glm::ivec3 &_cell, const F &_f) const {
+        uint bucket = bucketOf(_cell);
+        for (uint e = m_bucket_offsets[bucket]; e < m_bucket_offsets[bucket + 1]; e++) {
+            if (m_entries[e].cell == _cell)
+                _f(uint(m_entries[e].item));
+        }
+    }
+
+    // _f(uint _item) once for every item overlapping one of the cells [_min_cell; _max_cell]:
+    // an item is only reported in the first cell shared by both ranges, i.e. along every axis
+    // the first cell of the item, or the first cell of the range if the item started before
+    template <class F>
+    inline void forEachInCells(const glm::ivec3 &_min_cell, const glm::ivec3 &_max_cell, const F &_f) const {
+        glm::ivec3 cell;
+        for (cell.x = _min_cell.x; cell.x <= _max_cell.x; cell.x++)
+            for (cell.y = _min_cell.y; cell.y <= _max_cell.y; cell.y++)
+                for (cell.z = _min_cell.z; cell.z <= _max_cell.z; cell.z++) {
+                    uint first_axes = (cell.x == _min_cell.x) | (cell.y == _min_cell.y) << 1 | (cell.z == _min_cell.z) << 2;
+                    uint bucket = bucketOf(cell);
+                    for (uint e = m_bucket_offsets[bucket]; e < m_bucket_offsets[bucket + 1]; e++) {
+                        const Entry &entry = m_entries[e];
+                        if (entry.cell == cell && (entry.axes & ~first_axes) == 0)
+                            _f(uint(entry.item));
+                    }
+                }
+    }
+
+    // _f(uint _item) for every item whose cells overlap the box [_min; _max]
+    template <class F>
+    inline void forEachInBox(const glm::vec3 &_min, const glm::vec3 &_max, const F &_f) const {
+        forEachInCells(cellOf(_min), cellOf(_max), _f);
+    }
+
+    // _f(uint _item) for every item in the cells of _item or next to them (_item included)
+    template <class F>
+    inline void forEachNeighbor(uint _item, const F &_f) const {
+        forEachInCells(m_item_min_cells[_item] - 1, m_item_max_cells[_item] + 1, _f);
+    }
+};
@@ -0,0 +1,104 @@
+#include "StreamingBuffer.hpp"
+#include <cstring>
+
+// Timeout of one wait of a fence, waited again until it is signaled
+static const GLuint64 FENCE_TIMEOUT = 1000000000; // ns
+
+static bool g_persistent_mapping = true;
+
+bool StreamingBuffer::persistentMappingSupported() {
+    return g_persistent_mapping && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && glBufferStorage != nullptr;
+}
+
+void StreamingBuffer::setPersistentMapping(bool _enabled) {
+    g_persistent_mapping = _enabled;
+}
+
+void StreamingBuffer::allocate(size_t _size) {
+    clear();
+    m_generation++;
+    m_region_size = _size;
+    m_persistent = persistentMappingSupported();
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (m_persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, REGION_COUNT * _size, nullptr, flags);
+        m_mapping = static_cast<char *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, REGION_COUNT * _size, flags));
+        if (!m_mapping) { // storage without a mapping: start again on the fallback
+            glDeleteBuffers(1, &m_buffer);
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+            m_persistent = false;
+        }
+    }
+    if (!m_persistent)
+        glBufferData(GL_ARRAY_BUFFER, _size, nullptr, GL_STREAM_DRAW);
+    m_region = 0;
+}
+
+void *StreamingBuffer::map(size_t _size) {
+    if (!m_buffer || _size != m_region_size)
+        allocate(_size);
+
+    if (m_persistent) {
+        // the draws of the current region are all issued: fence them, then wait for the draws of the next region
+        if (m_fences[m_region])
+            glDeleteSync(m_fences[m_region]);
+        m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_mapped_region = (m_region + 1) % REGION_COUNT;
+        GLsync &fence = m_fences[m_mapped_region];
+        if (fence) {
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            for (GLenum status = GL_TIMEOUT_EXPIRED; status == GL_TIMEOUT_EXPIRED; flags = 0)
+                status = glClientWaitSync(fence, flags, FENCE_TIMEOUT);
+            glDeleteSync(fence);
+            fence = 0;
+        }
+        return m_mapping + m_mapped_region * m_region_size;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, _size, nullptr, GL_STREAM_DRAW); // orphaning
+    void *mapping = glMapBufferRange(GL_ARRAY_BUFFER, 0, _size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    m_staged = mapping == nullptr;
+    if (m_staged) {
+        m_staging.resize(_size);
+        mapping = m_staging.data();
+    }
+    return mapping;
+}
+
+void StreamingBuffer::unmap() {
+    if (m_persistent) {
+        m_region = m_mapped_region; // coherent mapping: nothing to flush
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (m_staged)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, m_region_size, m_staging.data());
+    else
+        glUnmapBuffer(GL_ARRAY_BUFFER); // false when the storage was lost (e.g. mode switch), until the next write
+}
+
+void StreamingBuffer::clear() {
+    for (GLsync &fence : m_fences) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    if (m_buffer) {
+        if (m_mapping) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        glDeleteBuffers(1, &m_buffer);
+    }
+    m_buffer = 0;
+    m_mapping = nullptr;
+    m_region_size = 0;
+    m_persistent = false;
+    m_region = m_mapped_region = 0;
+    m_staging.clear();
+    m_staged = false;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// GLEW
+#include <GL/glew.h>
+
+// USUAL INCLUDES
+#include <cstddef>
+#include <vector>
+#include <sys/types.h>
+
+/*
+READ "Buffer Object Streaming" (OpenGL wiki) and "Persistent Mapped Buffers" (AZDO, GDC 2014).
+Vertex buffer rewritten every frame (e.g. the positions of a simulated object), without reallocating its storage nor
+making the driver copy synchronously:
+- persistent path (GL 4.4 or ARB_buffer_storage): immutable storage of REGION_COUNT regions, mapped once (write,
+  persistent, coherent). Every frame is written in place in the next region, then drawn from it. A fence is inserted
+  when the renderer leaves a region and waited before that region is written again, REGION_COUNT - 1 frames later:
+  the wait only blocks when the GPU is that far behind
+- fallback (no persistent mapping, e.g. GL 3.3): one region, orphaned every frame (glBufferData(NULL) gives a fresh
+  storage while the GPU still reads the former one) then mapped with glMapBufferRange(INVALIDATE_BUFFER), or written
+  by glBufferSubData from a staging copy if the driver refuses the mapping
+map() returns the memory the frame is written into (e.g. by DynamicObject::packPositions, with no intermediate copy),
+unmap() makes it the current region. The current region starts at offset(): draw with a base vertex
+(glDrawElementsBaseVertex), so that the attribute pointers of the VAO never change.
+*/
+class StreamingBuffer {
+public:
+    static const uint REGION_COUNT = 3;
+
+private:
+    GLuint m_buffer = 0;
+    size_t m_region_size = 0;           // bytes
+    bool m_persistent = false;
+    char *m_mapping = nullptr;          // persistent path: the REGION_COUNT regions
+    GLsync m_fences[REGION_COUNT] = {}; // inserted when the region was left
+    uint m_region = 0;                  // current region (the last one written)
+    uint m_mapped_region = 0;           // region returned by map
+    std::vector<char> m_staging;        // fallback, when glMapBufferRange fails
+    bool m_staged = false;
+    uint m_generation = 0;              // allocations so far, never reset (GL may give a deleted name again)
+
+    void allocate(size_t _size);
+
+public:
+    StreamingBuffer() {}
+    ~StreamingBuffer() { clear(); }
+    StreamingBuffer(const StreamingBuffer &) = delete;
+    StreamingBuffer &operator=(const StreamingBuffer &) = delete;
+
+    // Memory to write the _size bytes of the next frame into. A different _size reallocates the buffer: generation()
+    // changes, the attribute pointers must be set again.
+    void *map(size_t _size);
+    void unmap();
+    void clear(); // needs the GL context
+
+    inline GLuint buffer() const { return m_buffer; }
+    inline uint generation() const { return m_generation; } // 0 before the first map
+    inline size_t offset() const { return m_persistent ? m_region * m_region_size : 0; } // of the current region
+    inline bool isPersistent() const { return m_persistent; }
+    static bool persistentMappingSupported();        // by the current context, and not disabled
+    static void setPersistentMapping(bool _enabled); // false forces the fallback of the buffers allocated next (to compare)
+};
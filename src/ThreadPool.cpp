@@ -0,0 +1,90 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+static thread_local bool t_inside_job = false;
+
+ThreadPool::ThreadPool(uint _thread_count) : m_next_chunk(0) {
+    if (_thread_count == 0)
+        _thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for (uint i = 1; i < _thread_count; i++)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start_condition.notify_all();
+    for (std::thread &worker : m_workers)
+        worker.join();
+}
+
+ThreadPool &ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::processChunks() {
+    bool was_inside_job = t_inside_job;
+    t_inside_job = true;
+    for (uint chunk = m_next_chunk++; chunk < m_chunk_count; chunk = m_next_chunk++) {
+        uint begin = m_begin + chunk * m_grain;
+        uint end = std::min(begin + m_grain, m_end);
+        m_function(m_context, chunk, begin, end);
+    }
+    t_inside_job = was_inside_job;
+}
+
+void ThreadPool::run(uint _begin, uint _end, uint _grain, ChunkFunction _function, const void *_context) {
+    _grain = std::max(1u, _grain);
+    uint chunk_count = chunkCount(_begin, _end, _grain);
+
+    // Serial path: nothing to share, no worker or nested job
+    if (chunk_count <= 1 || m_workers.empty() || t_inside_job) {
+        for (uint chunk = 0; chunk < chunk_count; chunk++) {
+            uint begin = _begin + chunk * _grain;
+            _function(_context, chunk, begin, std::min(begin + _grain, _end));
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(m_run_mutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_function = _function;
+        m_context = _context;
+        m_begin = _begin;
+        m_end = _end;
+        m_grain = _grain;
+        m_chunk_count = chunk_count;
+        m_next_chunk = 0;
+        m_active_workers = m_workers.size();
+        m_generation++;
+    }
+    m_start_condition.notify_all();
+
+    processChunks();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_condition.wait(lock, [this]() { return m_active_workers == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    uint seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start_condition.wait(lock, [&]() { return m_stop || m_generation != seen_generation; });
+            if (m_stop)
+                return;
+            seen_generation = m_generation;
+        }
+
+        processChunks();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_active_workers == 0)
+            m_done_condition.notify_one();
+    }
+}
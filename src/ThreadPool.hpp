@@ -0,0 +1,68 @@
+#pragma once
+
+// USUAL INCLUDES
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Minimal fork-join pool used by the solver.
+A job is a range [begin; end[ cut in chunks of _grain indices. The chunk partition only depends on the range
+and the grain, never on the number of threads, so per-chunk partial results can be combined deterministically.
+The calling thread takes part in the job. Nested calls (from inside a job) run serially on the calling thread.
+No heap allocation happens when a job is submitted.
+*/
+class ThreadPool {
+    typedef void (*ChunkFunction)(const void *_context, uint _chunk, uint _begin, uint _end);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_run_mutex; // only one job at a time
+
+    std::mutex m_mutex;
+    std::condition_variable m_start_condition;
+    std::condition_variable m_done_condition;
+    bool m_stop = false;
+    uint m_generation = 0; // incremented for every job
+    uint m_active_workers = 0;
+
+    // current job
+    ChunkFunction m_function = nullptr;
+    const void *m_context = nullptr;
+    uint m_begin = 0, m_end = 0, m_grain = 1, m_chunk_count = 0;
+    std::atomic<uint> m_next_chunk;
+
+    template <class F>
+    static void callChunk(const void *_context, uint _chunk, uint _begin, uint _end) {
+        (*static_cast<const F *>(_context))(_chunk, _begin, _end);
+    }
+
+    void run(uint _begin, uint _end, uint _grain, ChunkFunction _function, const void *_context);
+    void processChunks();
+    void workerLoop();
+
+public:
+    explicit ThreadPool(uint _thread_count = 0); // 0 -> std::thread::hardware_concurrency()
+    ~ThreadPool();
+
+    static ThreadPool &global();
+
+    inline uint threadCount() const { return m_workers.size() + 1; }
+    static inline uint chunkCount(uint _begin, uint _end, uint _grain) { return _end > _begin ? (_end - _begin + _grain - 1) / _grain : 0; }
+
+    // _f(uint _chunk, uint _chunk_begin, uint _chunk_end)
+    template <class F>
+    inline void parallelForChunks(uint _begin, uint _end, uint _grain, const F &_f) {
+        run(_begin, _end, _grain, &ThreadPool::callChunk<F>, &_f);
+    }
+
+    // _f(uint _i)
+    template <class F>
+    inline void parallelFor(uint _begin, uint _end, uint _grain, const F &_f) {
+        parallelForChunks(_begin, _end, _grain, [&_f](uint, uint _chunk_begin, uint _chunk_end) {
+            for (uint i = _chunk_begin; i < _chunk_end; i++)
+                _f(i);
+        });
+    }
+};
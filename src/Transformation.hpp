@@ -1,6 +1,8 @@
 #pragma once
 
+#ifndef HEADLESS
 #include <GLFW/glfw3.h>
+#endif
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <math.h>
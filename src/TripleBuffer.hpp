@@ -0,0 +1,33 @@
+#pragma once
+
+// USUAL INCLUDES
+#include <atomic>
+
+/*
+Lock-free single producer / single consumer triple buffer: the producer fills back() then publishes it, the consumer
+calls acquire() to get the newest published slot. Neither side ever waits: the producer always has a free slot
+(the third one), the consumer keeps reading the same slot until a newer one is published.
+*/
+template <class T>
+class TripleBuffer {
+    static const uint FRESH = 4; // the shared slot was published and not acquired yet
+
+    T m_slots[3];
+    uint m_back = 0;               // producer
+    std::atomic<uint> m_shared{1}; // exchanged between both sides, with the FRESH bit
+    uint m_front = 2;              // consumer
+
+public:
+    // Producer
+    inline T &back() { return m_slots[m_back]; }
+    inline void publish() { m_back = m_shared.exchange(m_back | FRESH, std::memory_order_acq_rel) & ~FRESH; }
+
+    // Consumer: returns true if the front slot changed
+    inline bool acquire() {
+        if (!(m_shared.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+    inline const T &front() const { return m_slots[m_front]; }
+};
@@ -0,0 +1,511 @@
+#include "VertexArrays.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VERTEX_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "the AoS kernels read glm::vec3 arrays as packed floats");
+
+/*
+Scalar versions, also used for the tail of the SIMD versions
+*/
+static void applyAccelerationScalar(Vec3Arrays &_velocities, const float *_weights, const glm::vec3 &_dv, uint _begin, uint _end) {
+    for (uint i = _begin; i < _end; i++) {
+        if (_weights[i] > 0.f) {
+            _velocities.x[i] += _dv.x;
+            _velocities.y[i] += _dv.y;
+            _velocities.z[i] += _dv.z;
+        }
+    }
+}
+
+static void predictPositionsScalar(const Vec3Arrays &_positions, const Vec3Arrays &_velocities, const float *_weights, float _delta_time, glm::vec3 *_new_positions, uint _begin, uint _end) {
+    for (uint i = _begin; i < _end; i++) {
+        float dt = _weights[i] > 0.f ? _delta_time : 0.f;
+        _new_positions[i] = glm::vec3(_positions.x[i] + dt * _velocities.x[i], _positions.y[i] + dt * _velocities.y[i], _positions.z[i] + dt * _velocities.z[i]);
+    }
+}
+
+static void updatePositionsScalar(const glm::vec3 *_new_positions, float _inv_delta_time, Vec3Arrays &_positions, Vec3Arrays &_velocities, uint _begin, uint _end) {
+    for (uint i = _begin; i < _end; i++) {
+        const glm::vec3 &p = _new_positions[i];
+        _velocities.x[i] = (p.x - _positions.x[i]) * _inv_delta_time;
+        _velocities.y[i] = (p.y - _positions.y[i]) * _inv_delta_time;
+        _velocities.z[i] = (p.z - _positions.z[i]) * _inv_delta_time;
+        _positions.x[i] = p.x;
+        _positions.y[i] = p.y;
+        _positions.z[i] = p.z;
+    }
+}
+
+static void packScalar(const Vec3Arrays &_vectors, glm::vec3 *_packed, uint _begin, uint _end) {
+    for (uint i = _begin; i < _end; i++)
+        _packed[i] = _vectors.get(i);
+}
+
+static void triangleNormalsScalar(const glm::vec3 *_positions, const glm::uvec3 *_triangles, const uint *_list, glm::vec3 *_normals, uint _begin, uint _end) {
+    for (uint k = _begin; k < _end; k++) {
+        const glm::uvec3 &triangle = _triangles[_list ? _list[k] : k];
+        const glm::vec3 &p0 = _positions[triangle.x];
+        _normals[k] = glm::cross(_positions[triangle.y] - p0, _positions[triangle.z] - p0);
+    }
+}
+
+// Columns of the rotation matrix of the unit quaternion w + xi + yj + zk
+static inline void rotationColumns(float _x, float _y, float _z, float _w, glm::vec3 &_r0, glm::vec3 &_r1, glm::vec3 &_r2) {
+    float xx = _x * _x, yy = _y * _y, zz = _z * _z, xy = _x * _y, xz = _x * _z, yz = _y * _z, wx = _w * _x, wy = _w * _y, wz = _w * _z;
+    _r0 = glm::vec3(1.f - 2.f * (yy + zz), 2.f * (xy + wz), 2.f * (xz - wy));
+    _r1 = glm::vec3(2.f * (xy - wz), 1.f - 2.f * (xx + zz), 2.f * (yz + wx));
+    _r2 = glm::vec3(2.f * (xz + wy), 2.f * (yz - wx), 1.f - 2.f * (xx + yy));
+}
+
+static void extractRotationsScalar(Mat3Arrays &_matrices, QuatArrays &_rotations, uint _iterations, uint _begin, uint _end) {
+    for (uint i = _begin; i < _end; i++) {
+        glm::mat3 a = _matrices.get(i);
+        float x = _rotations.x[i], y = _rotations.y[i], z = _rotations.z[i], w = _rotations.w[i];
+        glm::vec3 r0, r1, r2;
+        for (uint iteration = 0; iteration < _iterations; iteration++) {
+            rotationColumns(x, y, z, w, r0, r1, r2);
+            float scale = 1.f / (fabsf(glm::dot(r0, a[0]) + glm::dot(r1, a[1]) + glm::dot(r2, a[2])) + 1e-9f);
+            glm::vec3 omega = scale * (glm::cross(r0, a[0]) + glm::cross(r1, a[1]) + glm::cross(r2, a[2]));
+            glm::vec3 v = glm::vec3(x, y, z);
+            glm::vec3 new_v = v + 0.5f * (w * omega + glm::cross(omega, v));
+            float new_w = w - 0.5f * glm::dot(omega, v);
+            float inv_length = 1.f / sqrtf(new_w * new_w + glm::dot(new_v, new_v));
+            x = new_v.x * inv_length;
+            y = new_v.y * inv_length;
+            z = new_v.z * inv_length;
+            w = new_w * inv_length;
+        }
+        rotationColumns(x, y, z, w, r0, r1, r2);
+        _matrices.set(i, glm::mat3(r0, r1, r2));
+        _rotations.x[i] = x;
+        _rotations.y[i] = y;
+        _rotations.z[i] = z;
+        _rotations.w[i] = w;
+    }
+}
+
+#ifdef VERTEX_KERNELS_X86
+
+/*
+4 vertices: SoA registers (x0 x1 x2 x3) (y0 y1 y2 y3) (z0 z1 z2 z3) <-> AoS memory x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+*/
+static inline void storeAoS(float *_aos, __m128 _x, __m128 _y, __m128 _z) {
+    __m128 xy01 = _mm_unpacklo_ps(_x, _y);                            // x0 y0 x1 y1
+    __m128 xy23 = _mm_unpackhi_ps(_x, _y);                            // x2 y2 x3 y3
+    __m128 z0_x1 = _mm_shuffle_ps(_z, xy01, _MM_SHUFFLE(3, 2, 0, 0)); // z0 z0 x1 y1
+    __m128 y1_z1 = _mm_shuffle_ps(xy01, _z, _MM_SHUFFLE(1, 1, 3, 3)); // y1 y1 z1 z1
+    __m128 z2_x3 = _mm_shuffle_ps(_z, xy23, _MM_SHUFFLE(2, 2, 2, 2)); // z2 z2 x3 x3
+    __m128 y3_z3 = _mm_shuffle_ps(xy23, _z, _MM_SHUFFLE(3, 3, 3, 3)); // y3 y3 z3 z3
+    _mm_storeu_ps(_aos, _mm_shuffle_ps(xy01, z0_x1, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(_aos + 4, _mm_shuffle_ps(y1_z1, xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(_aos + 8, _mm_shuffle_ps(z2_x3, y3_z3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static inline void loadAoS(const float *_aos, __m128 &_x, __m128 &_y, __m128 &_z) {
+    __m128 a = _mm_loadu_ps(_aos), b = _mm_loadu_ps(_aos + 4), c = _mm_loadu_ps(_aos + 8);
+    _x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    _y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    _z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/*
+SSE2 versions (4 vertices per iteration)
+*/
+static void applyAccelerationSSE(Vec3Arrays &_velocities, const float *_weights, const glm::vec3 &_dv, uint _begin, uint _end) {
+    const __m128 zero = _mm_setzero_ps(), dvx = _mm_set1_ps(_dv.x), dvy = _mm_set1_ps(_dv.y), dvz = _mm_set1_ps(_dv.z);
+    uint i = _begin;
+    for (; i + 4 <= _end; i += 4) {
+        __m128 free_mask = _mm_cmpgt_ps(_mm_load_ps(_weights + i), zero);
+        _mm_store_ps(&_velocities.x[i], _mm_add_ps(_mm_load_ps(&_velocities.x[i]), _mm_and_ps(free_mask, dvx)));
+        _mm_store_ps(&_velocities.y[i], _mm_add_ps(_mm_load_ps(&_velocities.y[i]), _mm_and_ps(free_mask, dvy)));
+        _mm_store_ps(&_velocities.z[i], _mm_add_ps(_mm_load_ps(&_velocities.z[i]), _mm_and_ps(free_mask, dvz)));
+    }
+    applyAccelerationScalar(_velocities, _weights, _dv, i, _end);
+}
+
+static void predictPositionsSSE(const Vec3Arrays &_positions, const Vec3Arrays &_velocities, const float *_weights, float _delta_time, glm::vec3 *_new_positions, uint _begin, uint _end) {
+    const __m128 zero = _mm_setzero_ps(), dt = _mm_set1_ps(_delta_time);
+    uint i = _begin;
+    for (; i + 4 <= _end; i += 4) {
+        __m128 masked_dt = _mm_and_ps(_mm_cmpgt_ps(_mm_load_ps(_weights + i), zero), dt);
+        __m128 px = _mm_add_ps(_mm_load_ps(&_positions.x[i]), _mm_mul_ps(masked_dt, _mm_load_ps(&_velocities.x[i])));
+        __m128 py = _mm_add_ps(_mm_load_ps(&_positions.y[i]), _mm_mul_ps(masked_dt, _mm_load_ps(&_velocities.y[i])));
+        __m128 pz = _mm_add_ps(_mm_load_ps(&_positions.z[i]), _mm_mul_ps(masked_dt, _mm_load_ps(&_velocities.z[i])));
+        storeAoS(&_new_positions[i].x, px, py, pz);
+    }
+    predictPositionsScalar(_positions, _velocities, _weights, _delta_time, _new_positions, i, _end);
+}
+
+static void updatePositionsSSE(const glm::vec3 *_new_positions, float _inv_delta_time, Vec3Arrays &_positions, Vec3Arrays &_velocities, uint _begin, uint _end) {
+    const __m128 inv_dt = _mm_set1_ps(_inv_delta_time);
+    uint i = _begin;
+    for (; i + 4 <= _end; i += 4) {
+        __m128 px, py, pz;
+        loadAoS(&_new_positions[i].x, px, py, pz);
+        _mm_store_ps(&_velocities.x[i], _mm_mul_ps(_mm_sub_ps(px, _mm_load_ps(&_positions.x[i])), inv_dt));
+        _mm_store_ps(&_velocities.y[i], _mm_mul_ps(_mm_sub_ps(py, _mm_load_ps(&_positions.y[i])), inv_dt));
+        _mm_store_ps(&_velocities.z[i], _mm_mul_ps(_mm_sub_ps(pz, _mm_load_ps(&_positions.z[i])), inv_dt));
+        _mm_store_ps(&_positions.x[i], px);
+        _mm_store_ps(&_positions.y[i], py);
+        _mm_store_ps(&_positions.z[i], pz);
+    }
+    updatePositionsScalar(_new_positions, _inv_delta_time, _positions, _velocities, i, _end);
+}
+
+static void packSSE(const Vec3Arrays &_vectors, glm::vec3 *_packed, uint _begin, uint _end) {
+    uint i = _begin;
+    for (; i + 4 <= _end; i += 4)
+        storeAoS(&_packed[i].x, _mm_load_ps(&_vectors.x[i]), _mm_load_ps(&_vectors.y[i]), _mm_load_ps(&_vectors.z[i]));
+    packScalar(_vectors, _packed, i, _end);
+}
+
+/*
+SSE2 rotation extraction (4 matrices per iteration), the same operations as extractRotationsScalar lane by lane
+*/
+struct Vec3SSE {
+    __m128 x, y, z;
+};
+
+static inline __m128 dotSSE(const Vec3SSE &_a, const Vec3SSE &_b) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_a.x, _b.x), _mm_mul_ps(_a.y, _b.y)), _mm_mul_ps(_a.z, _b.z));
+}
+
+static inline Vec3SSE crossSSE(const Vec3SSE &_a, const Vec3SSE &_b) {
+    return {_mm_sub_ps(_mm_mul_ps(_a.y, _b.z), _mm_mul_ps(_a.z, _b.y)),
+            _mm_sub_ps(_mm_mul_ps(_a.z, _b.x), _mm_mul_ps(_a.x, _b.z)),
+            _mm_sub_ps(_mm_mul_ps(_a.x, _b.y), _mm_mul_ps(_a.y, _b.x))};
+}
+
+static inline void rotationColumnsSSE(__m128 _x, __m128 _y, __m128 _z, __m128 _w, Vec3SSE _r[3]) {
+    const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+    __m128 xx = _mm_mul_ps(_x, _x), yy = _mm_mul_ps(_y, _y), zz = _mm_mul_ps(_z, _z);
+    __m128 xy = _mm_mul_ps(_x, _y), xz = _mm_mul_ps(_x, _z), yz = _mm_mul_ps(_y, _z);
+    __m128 wx = _mm_mul_ps(_w, _x), wy = _mm_mul_ps(_w, _y), wz = _mm_mul_ps(_w, _z);
+    _r[0] = {_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_add_ps(xy, wz)), _mm_mul_ps(two, _mm_sub_ps(xz, wy))};
+    _r[1] = {_mm_mul_ps(two, _mm_sub_ps(xy, wz)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), _mm_mul_ps(two, _mm_add_ps(yz, wx))};
+    _r[2] = {_mm_mul_ps(two, _mm_add_ps(xz, wy)), _mm_mul_ps(two, _mm_sub_ps(yz, wx)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)))};
+}
+
+static void extractRotationsSSE(Mat3Arrays &_matrices, QuatArrays &_rotations, uint _iterations, uint _begin, uint _end) {
+    const __m128 half = _mm_set1_ps(0.5f), epsilon = _mm_set1_ps(1e-9f), one = _mm_set1_ps(1.f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    uint i = _begin;
+    for (; i + 4 <= _end; i += 4) {
+        Vec3SSE a[3];
+        for (uint k = 0; k < 3; k++)
+            a[k] = {_mm_load_ps(&_matrices.m[3 * k][i]), _mm_load_ps(&_matrices.m[3 * k + 1][i]), _mm_load_ps(&_matrices.m[3 * k + 2][i])};
+        __m128 x = _mm_load_ps(&_rotations.x[i]), y = _mm_load_ps(&_rotations.y[i]);
+        __m128 z = _mm_load_ps(&_rotations.z[i]), w = _mm_load_ps(&_rotations.w[i]);
+        Vec3SSE r[3];
+        for (uint iteration = 0; iteration < _iterations; iteration++) {
+            rotationColumnsSSE(x, y, z, w, r);
+            __m128 trace = _mm_add_ps(_mm_add_ps(dotSSE(r[0], a[0]), dotSSE(r[1], a[1])), dotSSE(r[2], a[2]));
+            __m128 scale = _mm_div_ps(one, _mm_add_ps(_mm_and_ps(trace, abs_mask), epsilon));
+            Vec3SSE c0 = crossSSE(r[0], a[0]), c1 = crossSSE(r[1], a[1]), c2 = crossSSE(r[2], a[2]);
+            Vec3SSE omega = {_mm_mul_ps(scale, _mm_add_ps(_mm_add_ps(c0.x, c1.x), c2.x)),
+                             _mm_mul_ps(scale, _mm_add_ps(_mm_add_ps(c0.y, c1.y), c2.y)),
+                             _mm_mul_ps(scale, _mm_add_ps(_mm_add_ps(c0.z, c1.z), c2.z))};
+            Vec3SSE v = {x, y, z};
+            Vec3SSE omega_v = crossSSE(omega, v);
+            __m128 new_x = _mm_add_ps(x, _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(w, omega.x), omega_v.x)));
+            __m128 new_y = _mm_add_ps(y, _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(w, omega.y), omega_v.y)));
+            __m128 new_z = _mm_add_ps(z, _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(w, omega.z), omega_v.z)));
+            __m128 new_w = _mm_sub_ps(w, _mm_mul_ps(half, dotSSE(omega, v)));
+            __m128 length2 = _mm_add_ps(_mm_mul_ps(new_w, new_w), dotSSE({new_x, new_y, new_z}, {new_x, new_y, new_z}));
+            __m128 inv_length = _mm_div_ps(one, _mm_sqrt_ps(length2));
+            x = _mm_mul_ps(new_x, inv_length);
+            y = _mm_mul_ps(new_y, inv_length);
+            z = _mm_mul_ps(new_z, inv_length);
+            w = _mm_mul_ps(new_w, inv_length);
+        }
+        rotationColumnsSSE(x, y, z, w, r);
+        for (uint k = 0; k < 3; k++) {
+            _mm_store_ps(&_matrices.m[3 * k][i], r[k].x);
+            _mm_store_ps(&_matrices.m[3 * k + 1][i], r[k].y);
+            _mm_store_ps(&_matrices.m[3 * k + 2][i], r[k].z);
+        }
+        _mm_store_ps(&_rotations.x[i], x);
+        _mm_store_ps(&_rotations.y[i], y);
+        _mm_store_ps(&_rotations.z[i], z);
+        _mm_store_ps(&_rotations.w[i], w);
+    }
+    extractRotationsScalar(_matrices, _rotations, _iterations, i, _end);
+}
+
+/*
+AVX2 + FMA versions (8 vertices per iteration, the AoS side is transposed as two halves of 4)
+*/
+#define AVX2_KERNEL __attribute__((target("avx2,fma")))
+
+AVX2_KERNEL static inline void storeAoS(float *_aos, __m256 _x, __m256 _y, __m256 _z) {
+    storeAoS(_aos, _mm256_castps256_ps128(_x), _mm256_castps256_ps128(_y), _mm256_castps256_ps128(_z));
+    storeAoS(_aos + 12, _mm256_extractf128_ps(_x, 1), _mm256_extractf128_ps(_y, 1), _mm256_extractf128_ps(_z, 1));
+}
+
+AVX2_KERNEL static inline void loadAoS(const float *_aos, __m256 &_x, __m256 &_y, __m256 &_z) {
+    __m128 x_low, y_low, z_low, x_high, y_high, z_high;
+    loadAoS(_aos, x_low, y_low, z_low);
+    loadAoS(_aos + 12, x_high, y_high, z_high);
+    _x = _mm256_insertf128_ps(_mm256_castps128_ps256(x_low), x_high, 1);
+    _y = _mm256_insertf128_ps(_mm256_castps128_ps256(y_low), y_high, 1);
+    _z = _mm256_insertf128_ps(_mm256_castps128_ps256(z_low), z_high, 1);
+}
+
+AVX2_KERNEL static void applyAccelerationAVX2(Vec3Arrays &_velocities, const float *_weights, const glm::vec3 &_dv, uint _begin, uint _end) {
+    const __m256 zero = _mm256_setzero_ps(), dvx = _mm256_set1_ps(_dv.x), dvy = _mm256_set1_ps(_dv.y), dvz = _mm256_set1_ps(_dv.z);
+    uint i = _begin;
+    for (; i + 8 <= _end; i += 8) {
+        __m256 free_mask = _mm256_cmp_ps(_mm256_load_ps(_weights + i), zero, _CMP_GT_OQ);
+        _mm256_store_ps(&_velocities.x[i], _mm256_add_ps(_mm256_load_ps(&_velocities.x[i]), _mm256_and_ps(free_mask, dvx)));
+        _mm256_store_ps(&_velocities.y[i], _mm256_add_ps(_mm256_load_ps(&_velocities.y[i]), _mm256_and_ps(free_mask, dvy)));
+        _mm256_store_ps(&_velocities.z[i], _mm256_add_ps(_mm256_load_ps(&_velocities.z[i]), _mm256_and_ps(free_mask, dvz)));
+    }
+    applyAccelerationScalar(_velocities, _weights, _dv, i, _end);
+}
+
+AVX2_KERNEL static void predictPositionsAVX2(const Vec3Arrays &_positions, const Vec3Arrays &_velocities, const float *_weights, float _delta_time, glm::vec3 *_new_positions, uint _begin, uint _end) {
+    const __m256 zero = _mm256_setzero_ps(), dt = _mm256_set1_ps(_delta_time);
+    uint i = _begin;
+    for (; i + 8 <= _end; i += 8) {
+        __m256 masked_dt = _mm256_and_ps(_mm256_cmp_ps(_mm256_load_ps(_weights + i), zero, _CMP_GT_OQ), dt);
+        __m256 px = _mm256_fmadd_ps(masked_dt, _mm256_load_ps(&_velocities.x[i]), _mm256_load_ps(&_positions.x[i]));
+        __m256 py = _mm256_fmadd_ps(masked_dt, _mm256_load_ps(&_velocities.y[i]), _mm256_load_ps(&_positions.y[i]));
+        __m256 pz = _mm256_fmadd_ps(masked_dt, _mm256_load_ps(&_velocities.z[i]), _mm256_load_ps(&_positions.z[i]));
+        storeAoS(&_new_positions[i].x, px, py, pz);
+    }
+    predictPositionsScalar(_positions, _velocities, _weights, _delta_time, _new_positions, i, _end);
+}
+
+AVX2_KERNEL static void updatePositionsAVX2(const glm::vec3 *_new_positions, float _inv_delta_time, Vec3Arrays &_positions, Vec3Arrays &_velocities, uint _begin, uint _end) {
+    const __m256 inv_dt = _mm256_set1_ps(_inv_delta_time);
+    uint i = _begin;
+    for (; i + 8 <= _end; i += 8) {
+        __m256 px, py, pz;
+        loadAoS(&_new_positions[i].x, px, py, pz);
+        _mm256_store_ps(&_velocities.x[i], _mm256_mul_ps(_mm256_sub_ps(px, _mm256_load_ps(&_positions.x[i])), inv_dt));
+        _mm256_store_ps(&_velocities.y[i], _mm256_mul_ps(_mm256_sub_ps(py, _mm256_load_ps(&_positions.y[i])), inv_dt));
+        _mm256_store_ps(&_velocities.z[i], _mm256_mul_ps(_mm256_sub_ps(pz, _mm256_load_ps(&_positions.z[i])), inv_dt));
+        _mm256_store_ps(&_positions.x[i], px);
+        _mm256_store_ps(&_positions.y[i], py);
+        _mm256_store_ps(&_positions.z[i], pz);
+    }
+    updatePositionsScalar(_new_positions, _inv_delta_time, _positions, _velocities, i, _end);
+}
+
+AVX2_KERNEL static void packAVX2(const Vec3Arrays &_vectors, glm::vec3 *_packed, uint _begin, uint _end) {
+    uint i = _begin;
+    for (; i + 8 <= _end; i += 8)
+        storeAoS(&_packed[i].x, _mm256_load_ps(&_vectors.x[i]), _mm256_load_ps(&_vectors.y[i]), _mm256_load_ps(&_vectors.z[i]));
+    packScalar(_vectors, _packed, i, _end);
+}
+
+/*
+AVX2 + FMA rotation extraction (8 matrices per iteration)
+*/
+struct Vec3AVX2 {
+    __m256 x, y, z;
+};
+
+AVX2_KERNEL static inline __m256 dotAVX2(const Vec3AVX2 &_a, const Vec3AVX2 &_b) {
+    return _mm256_fmadd_ps(_a.x, _b.x, _mm256_fmadd_ps(_a.y, _b.y, _mm256_mul_ps(_a.z, _b.z)));
+}
+
+AVX2_KERNEL static inline Vec3AVX2 crossAVX2(const Vec3AVX2 &_a, const Vec3AVX2 &_b) {
+    return {_mm256_fmsub_ps(_a.y, _b.z, _mm256_mul_ps(_a.z, _b.y)),
+            _mm256_fmsub_ps(_a.z, _b.x, _mm256_mul_ps(_a.x, _b.z)),
+            _mm256_fmsub_ps(_a.x, _b.y, _mm256_mul_ps(_a.y, _b.x))};
+}
+
+AVX2_KERNEL static inline void rotationColumnsAVX2(__m256 _x, __m256 _y, __m256 _z, __m256 _w, Vec3AVX2 _r[3]) {
+    const __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f), minus_two = _mm256_set1_ps(-2.f);
+    __m256 xx = _mm256_mul_ps(_x, _x), yy = _mm256_mul_ps(_y, _y), zz = _mm256_mul_ps(_z, _z);
+    __m256 xy = _mm256_mul_ps(_x, _y), xz = _mm256_mul_ps(_x, _z), yz = _mm256_mul_ps(_y, _z);
+    __m256 wx = _mm256_mul_ps(_w, _x), wy = _mm256_mul_ps(_w, _y), wz = _mm256_mul_ps(_w, _z);
+    _r[0] = {_mm256_fmadd_ps(minus_two, _mm256_add_ps(yy, zz), one), _mm256_mul_ps(two, _mm256_add_ps(xy, wz)), _mm256_mul_ps(two, _mm256_sub_ps(xz, wy))};
+    _r[1] = {_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), _mm256_fmadd_ps(minus_two, _mm256_add_ps(xx, zz), one), _mm256_mul_ps(two, _mm256_add_ps(yz, wx))};
+    _r[2] = {_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), _mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), _mm256_fmadd_ps(minus_two, _mm256_add_ps(xx, yy), one)};
+}
+
+AVX2_KERNEL static void extractRotationsAVX2(Mat3Arrays &_matrices, QuatArrays &_rotations, uint _iterations, uint _begin, uint _end) {
+    const __m256 half = _mm256_set1_ps(0.5f), minus_half = _mm256_set1_ps(-0.5f), epsilon = _mm256_set1_ps(1e-9f), one = _mm256_set1_ps(1.f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    uint i = _begin;
+    for (; i + 8 <= _end; i += 8) {
+        Vec3AVX2 a[3];
+        for (uint k = 0; k < 3; k++)
+            a[k] = {_mm256_load_ps(&_matrices.m[3 * k][i]), _mm256_load_ps(&_matrices.m[3 * k + 1][i]), _mm256_load_ps(&_matrices.m[3 * k + 2][i])};
+        __m256 x = _mm256_load_ps(&_rotations.x[i]), y = _mm256_load_ps(&_rotations.y[i]);
+        __m256 z = _mm256_load_ps(&_rotations.z[i]), w = _mm256_load_ps(&_rotations.w[i]);
+        Vec3AVX2 r[3];
+        for (uint iteration = 0; iteration < _iterations; iteration++) {
+            rotationColumnsAVX2(x, y, z, w, r);
+            __m256 trace = _mm256_add_ps(_mm256_add_ps(dotAVX2(r[0], a[0]), dotAVX2(r[1], a[1])), dotAVX2(r[2], a[2]));
+            __m256 scale = _mm256_div_ps(one, _mm256_add_ps(_mm256_and_ps(trace, abs_mask), epsilon));
+            Vec3AVX2 c0 = crossAVX2(r[0], a[0]), c1 = crossAVX2(r[1], a[1]), c2 = crossAVX2(r[2], a[2]);
+            Vec3AVX2 omega = {_mm256_mul_ps(scale, _mm256_add_ps(_mm256_add_ps(c0.x, c1.x), c2.x)),
+                              _mm256_mul_ps(scale, _mm256_add_ps(_mm256_add_ps(c0.y, c1.y), c2.y)),
+                              _mm256_mul_ps(scale, _mm256_add_ps(_mm256_add_ps(c0.z, c1.z), c2.z))};
+            Vec3AVX2 v = {x, y, z};
+            Vec3AVX2 omega_v = crossAVX2(omega, v);
+            __m256 new_x = _mm256_fmadd_ps(half, _mm256_fmadd_ps(w, omega.x, omega_v.x), x);
+            __m256 new_y = _mm256_fmadd_ps(half, _mm256_fmadd_ps(w, omega.y, omega_v.y), y);
+            __m256 new_z = _mm256_fmadd_ps(half, _mm256_fmadd_ps(w, omega.z, omega_v.z), z);
+            __m256 new_w = _mm256_fmadd_ps(minus_half, dotAVX2(omega, v), w);
+            __m256 length2 = _mm256_fmadd_ps(new_w, new_w, dotAVX2({new_x, new_y, new_z}, {new_x, new_y, new_z}));
+            __m256 inv_length = _mm256_div_ps(one, _mm256_sqrt_ps(length2));
+            x = _mm256_mul_ps(new_x, inv_length);
+            y = _mm256_mul_ps(new_y, inv_length);
+            z = _mm256_mul_ps(new_z, inv_length);
+            w = _mm256_mul_ps(new_w, inv_length);
+        }
+        rotationColumnsAVX2(x, y, z, w, r);
+        for (uint k = 0; k < 3; k++) {
+            _mm256_store_ps(&_matrices.m[3 * k][i], r[k].x);
+            _mm256_store_ps(&_matrices.m[3 * k + 1][i], r[k].y);
+            _mm256_store_ps(&_matrices.m[3 * k + 2][i], r[k].z);
+        }
+        _mm256_store_ps(&_rotations.x[i], x);
+        _mm256_store_ps(&_rotations.y[i], y);
+        _mm256_store_ps(&_rotations.z[i], z);
+        _mm256_store_ps(&_rotations.w[i], w);
+    }
+    extractRotationsScalar(_matrices, _rotations, _iterations, i, _end);
+}
+
+// x, y and z of the AoS vectors _aos[_indices]
+AVX2_KERNEL static inline Vec3AVX2 gatherVec3AVX2(const float *_aos, __m256i _indices) {
+    __m256i offsets = _mm256_add_epi32(_indices, _mm256_add_epi32(_indices, _indices));
+    return {_mm256_i32gather_ps(_aos, offsets, 4), _mm256_i32gather_ps(_aos + 1, offsets, 4), _mm256_i32gather_ps(_aos + 2, offsets, 4)};
+}
+
+AVX2_KERNEL static void triangleNormalsAVX2(const glm::vec3 *_positions, const glm::uvec3 *_triangles, const uint *_list, glm::vec3 *_normals, uint _begin, uint _end) {
+    const float *positions = &_positions[0].x;
+    const int *indices = reinterpret_cast<const int *>(&_triangles[0].x);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    uint k = _begin;
+    for (; k + 8 <= _end; k += 8) {
+        __m256i triangles = _list ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_list + k)) : _mm256_add_epi32(_mm256_set1_epi32(k), lanes);
+        __m256i corners = _mm256_add_epi32(triangles, _mm256_add_epi32(triangles, triangles));
+        Vec3AVX2 p0 = gatherVec3AVX2(positions, _mm256_i32gather_epi32(indices, corners, 4));
+        Vec3AVX2 p1 = gatherVec3AVX2(positions, _mm256_i32gather_epi32(indices + 1, corners, 4));
+        Vec3AVX2 p2 = gatherVec3AVX2(positions, _mm256_i32gather_epi32(indices + 2, corners, 4));
+        Vec3AVX2 e1 = {_mm256_sub_ps(p1.x, p0.x), _mm256_sub_ps(p1.y, p0.y), _mm256_sub_ps(p1.z, p0.z)};
+        Vec3AVX2 e2 = {_mm256_sub_ps(p2.x, p0.x), _mm256_sub_ps(p2.y, p0.y), _mm256_sub_ps(p2.z, p0.z)};
+        Vec3AVX2 normal = crossAVX2(e1, e2);
+        storeAoS(&_normals[k].x, normal.x, normal.y, normal.z);
+    }
+    triangleNormalsScalar(_positions, _triangles, _list, _normals, k, _end);
+}
+
+static SimdLevel supportedSimdLevel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE;
+    return SIMD_SCALAR;
+}
+
+#else
+
+static SimdLevel supportedSimdLevel() {
+    return SIMD_SCALAR;
+}
+
+#endif
+
+static const SimdLevel g_supported_simd_level = supportedSimdLevel();
+static SimdLevel g_simd_level = g_supported_simd_level;
+
+namespace VertexKernels {
+
+SimdLevel simdLevel() {
+    return g_simd_level;
+}
+
+void setSimdLevel(SimdLevel _level) {
+    g_simd_level = _level < g_supported_simd_level ? _level : g_supported_simd_level;
+}
+
+void applyAcceleration(Vec3Arrays &_velocities, const float *_weights, const glm::vec3 &_acceleration, float _delta_time, uint _begin, uint _end) {
+    glm::vec3 dv = _delta_time * _acceleration;
+    switch (g_simd_level) {
+#ifdef VERTEX_KERNELS_X86
+    case SIMD_AVX2:
+        return applyAccelerationAVX2(_velocities, _weights, dv, _begin, _end);
+    case SIMD_SSE:
+        return applyAccelerationSSE(_velocities, _weights, dv, _begin, _end);
+#endif
+    default:
+        return applyAccelerationScalar(_velocities, _weights, dv, _begin, _end);
+    }
+}
+
+void predictPositions(const Vec3Arrays &_positions, const Vec3Arrays &_velocities, const float *_weights, float _delta_time, glm::vec3 *_new_positions, uint _begin, uint _end) {
+    switch (g_simd_level) {
+#ifdef VERTEX_KERNELS_X86
+    case SIMD_AVX2:
+        return predictPositionsAVX2(_positions, _velocities, _weights, _delta_time, _new_positions, _begin, _end);
+    case SIMD_SSE:
+        return predictPositionsSSE(_positions, _velocities, _weights, _delta_time, _new_positions, _begin, _end);
+#endif
+    default:
+        return predictPositionsScalar(_positions, _velocities, _weights, _delta_time, _new_positions, _begin, _end);
+    }
+}
+
+void updatePositions(const glm::vec3 *_new_positions, float _delta_time, Vec3Arrays &_positions, Vec3Arrays &_velocities, uint _begin, uint _end) {
+    float inv_delta_time = 1.f / _delta_time;
+    switch (g_simd_level) {
+#ifdef VERTEX_KERNELS_X86
+    case SIMD_AVX2:
+        return updatePositionsAVX2(_new_positions, inv_delta_time, _positions, _velocities, _begin, _end);
+    case SIMD_SSE:
+        return updatePositionsSSE(_new_positions, inv_delta_time, _positions, _velocities, _begin, _end);
+#endif
+    default:
+        return updatePositionsScalar(_new_positions, inv_delta_time, _positions, _velocities, _begin, _end);
+    }
+}
+
+void pack(const Vec3Arrays &_vectors, glm::vec3 *_packed, uint _begin, uint _end) {
+    switch (g_simd_level) {
+#ifdef VERTEX_KERNELS_X86
+    case SIMD_AVX2:
+        return packAVX2(_vectors, _packed, _begin, _end);
+    case SIMD_SSE:
+        return packSSE(_vectors, _packed, _begin, _end);
+#endif
+    default:
+        return packScalar(_vectors, _packed, _begin, _end);
+    }
+}
+
+} // namespace VertexKernels
+
+void MatrixKernels::extractRotations(Mat3Arrays &_matrices, QuatArrays &_rotations, uint _iterations, uint _begin, uint _end) {
+    switch (g_simd_level) {
+#ifdef VERTEX_KERNELS_X86
+    case SIMD_AVX2:
+        return extractRotationsAVX2(_matrices, _rotations, _iterations, _begin, _end);
+    case SIMD_SSE:
+        return extractRotationsSSE(_matrices, _rotations, _iterations, _begin, _end);
+#endif
+    default:
+        return extractRotationsScalar(_matrices, _rotations, _iterations, _begin, _end);
+    }
+}
+
+void TriangleKernels::normals(const glm::vec3 *_positions, const glm::uvec3 *_triangles, const uint *_list, glm::vec3 *_normals, uint _begin, uint _end) {
+    switch (g_simd_level) {
+#ifdef VERTEX_KERNELS_X86
+    case SIMD_AVX2:
+        return triangleNormalsAVX2(_positions, _triangles, _list, _normals, _begin, _end);
+#endif
+    default:
+        return triangleNormalsScalar(_positions, _triangles, _list, _normals, _begin, _end);
+    }
+}
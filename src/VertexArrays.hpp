@@ -0,0 +1,174 @@
+#pragma once
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Every SoA array is aligned and padded for the widest kernel (8 floats with AVX2)
+static const uint SIMD_WIDTH = 8;
+static const size_t SIMD_ALIGNMENT = SIMD_WIDTH * sizeof(float);
+
+inline uint paddedSize(uint _size) { return (_size + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH; }
+
+template <class T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() = default;
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    T *allocate(size_t _count) {
+        void *pointer = nullptr;
+        if (posix_memalign(&pointer, SIMD_ALIGNMENT, _count * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return static_cast<T *>(pointer);
+    }
+    void deallocate(T *_pointer, size_t) { free(_pointer); }
+
+    template <class U>
+    bool operator==(const AlignedAllocator<U> &) const { return true; }
+    template <class U>
+    bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloats;
+
+/*
+Structure of arrays of 3D vectors: x, y and z are separate aligned float arrays, padded with zeros
+to a multiple of SIMD_WIDTH, so that the per-vertex kernels never need a scalar tail.
+*/
+struct Vec3Arrays {
+    AlignedFloats x, y, z;
+
+    inline uint size() const { return m_size; }
+    inline uint paddedSize() const { return x.size(); }
+
+    void resize(uint _size) {
+        m_size = _size;
+        uint padded_size = ::paddedSize(_size);
+        x.resize(padded_size, 0.f);
+        y.resize(padded_size, 0.f);
+        z.resize(padded_size, 0.f);
+    }
+    void push_back(const glm::vec3 &_vector) {
+        resize(m_size + 1);
+        set(m_size - 1, _vector);
+    }
+    void clear() {
+        m_size = 0;
+        x.clear();
+        y.clear();
+        z.clear();
+    }
+
+    inline glm::vec3 get(uint _i) const { return glm::vec3(x[_i], y[_i], z[_i]); }
+    inline void set(uint _i, const glm::vec3 &_vector) {
+        x[_i] = _vector.x;
+        y[_i] = _vector.y;
+        z[_i] = _vector.z;
+    }
+
+private:
+    uint m_size = 0;
+};
+
+/*
+Structures of arrays of 3x3 matrices (column-major: m[3 * column + row]) and of quaternions, one lane per matrix,
+padded like Vec3Arrays so that a SIMD register holds the same coefficient of SIMD_WIDTH matrices.
+*/
+struct Mat3Arrays {
+    AlignedFloats m[9];
+
+    inline uint size() const { return m_size; }
+    void resize(uint _size) {
+        m_size = _size;
+        for (AlignedFloats &coefficients : m)
+            coefficients.resize(::paddedSize(_size), 0.f);
+    }
+
+    inline glm::mat3 get(uint _i) const {
+        return glm::mat3(m[0][_i], m[1][_i], m[2][_i], m[3][_i], m[4][_i], m[5][_i], m[6][_i], m[7][_i], m[8][_i]);
+    }
+    inline void set(uint _i, const glm::mat3 &_matrix) {
+        for (uint k = 0; k < 9; k++)
+            m[k][_i] = _matrix[k / 3][k % 3];
+    }
+
+private:
+    uint m_size = 0;
+};
+
+struct QuatArrays {
+    AlignedFloats x, y, z, w; // w + xi + yj + zk
+
+    // new quaternions are the identity
+    void resize(uint _size) {
+        uint padded_size = ::paddedSize(_size);
+        x.resize(padded_size, 0.f);
+        y.resize(padded_size, 0.f);
+        z.resize(padded_size, 0.f);
+        w.resize(padded_size, 1.f);
+    }
+    void clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+        w.clear();
+    }
+};
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE,  // SSE2 (4 floats)
+    SIMD_AVX2, // AVX2 + FMA (8 floats)
+};
+
+/*
+Per-vertex kernels of the solver, on SoA positions / velocities.
+The implementation is picked at runtime from what the CPU supports; setSimdLevel can only lower it (to compare).
+A vertex is fixed when its inverse mass w is 0: the kernels use w > 0 as a mask instead of branching.
+The ranges [_begin; _end[ should start on a multiple of SIMD_WIDTH (aligned loads), the vertices after the
+last full SIMD register go through the scalar path (none when _end is the padded size).
+*/
+namespace VertexKernels {
+SimdLevel simdLevel();
+void setSimdLevel(SimdLevel _level); // clamped to what the CPU supports
+
+// (5) vi ← vi + ∆t ai for every vertex with wi > 0
+void applyAcceleration(Vec3Arrays &_velocities, const float *_weights, const glm::vec3 &_acceleration, float _delta_time, uint _begin, uint _end);
+// (7) pi ← xi + ∆t vi (xi if wi = 0), pi is AoS since the constraints gather whole vertices
+void predictPositions(const Vec3Arrays &_positions, const Vec3Arrays &_velocities, const float *_weights, float _delta_time, glm::vec3 *_new_positions, uint _begin, uint _end);
+// (12)-(15) vi ← (pi − xi) / ∆t, xi ← pi
+void updatePositions(const glm::vec3 *_new_positions, float _delta_time, Vec3Arrays &_positions, Vec3Arrays &_velocities, uint _begin, uint _end);
+// SoA -> AoS (rendering)
+void pack(const Vec3Arrays &_vectors, glm::vec3 *_packed, uint _begin, uint _end);
+} // namespace VertexKernels
+
+/*
+3x3 kernels, one matrix per SIMD lane (dispatched like VertexKernels)
+*/
+namespace MatrixKernels {
+/*
+READ "A Robust Method to Extract the Rotational Part of Deformations" (Müller 2016).
+Replaces every matrix A in [_begin; _end[ by its rotational part R (the rotation of its polar decomposition), found
+as the rotation q which maximizes ∑k Rk . Ak (Rk, Ak the columns), warm-started from _rotations:
+    ω = ∑k Rk x Ak / (|∑k Rk . Ak| + ε)    q ← normalize(q + ½ (0, ω) q)
+The update is the first order of the rotation of angle |ω| around ω, so every iteration is only made of
+multiplications, additions and one square root. _rotations receives q for the next step.
+*/
+void extractRotations(Mat3Arrays &_matrices, QuatArrays &_rotations, uint _iterations, uint _begin, uint _end);
+} // namespace MatrixKernels
+
+/*
+Triangle kernels on AoS meshes (dispatched like VertexKernels)
+*/
+namespace TriangleKernels {
+// _normals[k] ← (p1 − p0) × (p2 − p0) of the triangle t = _list ? _list[k] : k, for k in [_begin; _end[ (the unit
+// normal times twice the area). AVX2 gathers the vertices of 8 triangles, SSE2 has no gather and uses the scalar path.
+void normals(const glm::vec3 *_positions, const glm::uvec3 *_triangles, const uint *_list, glm::vec3 *_normals, uint _begin, uint _end);
+} // namespace TriangleKernels
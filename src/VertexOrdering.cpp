@@ -0,0 +1,139 @@
+#include "VertexOrdering.hpp"
+#include <algorithm>
+#include <cstdint>
+
+// Inserts two zero bits between the 10 low bits of _v
+static uint32_t spreadBits(uint32_t _v) {
+    _v &= 0x3ff;
+    _v = (_v | (_v << 16)) & 0x030000ff;
+    _v = (_v | (_v << 8)) & 0x0300f00f;
+    _v = (_v | (_v << 4)) & 0x030c30c3;
+    _v = (_v | (_v << 2)) & 0x09249249;
+    return _v;
+}
+
+std::vector<uint> VertexOrdering::mortonOrder(const std::vector<glm::vec3> &_positions) {
+    const uint n = _positions.size();
+    std::vector<uint> order(n);
+    if (n == 0)
+        return order;
+
+    glm::vec3 min = _positions[0], max = _positions[0];
+    for (const glm::vec3 &position : _positions) {
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    glm::vec3 extent = max - min;
+    float scale = 1023.f / std::max(std::max(std::max(extent.x, extent.y), extent.z), 1e-12f); // same scale on every axis
+
+    std::vector<uint64_t> keys(n); // code << 32 | old index, so that the sort is deterministic
+    for (uint i = 0; i < n; i++) {
+        glm::uvec3 cell = glm::uvec3((_positions[i] - min) * scale);
+        uint32_t code = spreadBits(cell.x) | spreadBits(cell.y) << 1 | spreadBits(cell.z) << 2;
+        keys[i] = uint64_t(code) << 32 | i;
+    }
+    std::sort(keys.begin(), keys.end());
+    for (uint i = 0; i < n; i++)
+        order[i] = uint(keys[i]);
+    return order;
+}
+
+std::vector<uint> VertexOrdering::reverseCuthillMcKeeOrder(uint _vertex_count, const std::vector<glm::uvec2> &_edges) {
+    const uint n = _vertex_count;
+
+    // CSR adjacency: the neighbors of i are neighbors[offsets[i]; offsets[i + 1][, sorted and unique
+    std::vector<uint> offsets(n + 1, 0), neighbors(2 * _edges.size());
+    for (const glm::uvec2 &edge : _edges) {
+        offsets[edge.x + 1]++;
+        offsets[edge.y + 1]++;
+    }
+    for (uint i = 0; i < n; i++)
+        offsets[i + 1] += offsets[i];
+    std::vector<uint> cursors(offsets.begin(), offsets.end() - 1);
+    for (const glm::uvec2 &edge : _edges) {
+        neighbors[cursors[edge.x]++] = edge.y;
+        neighbors[cursors[edge.y]++] = edge.x;
+    }
+    uint unique_count = 0;
+    for (uint i = 0; i < n; i++) {
+        std::vector<uint>::iterator begin = neighbors.begin() + offsets[i], end = neighbors.begin() + offsets[i + 1];
+        std::sort(begin, end);
+        end = std::unique(begin, end);
+        uint first = unique_count;
+        for (std::vector<uint>::iterator it = begin; it != end; ++it)
+            if (*it != i) // no self loop
+                neighbors[unique_count++] = *it;
+        offsets[i] = first;
+    }
+    offsets[n] = unique_count;
+    auto degree = [&](uint _i) { return offsets[_i + 1] - offsets[_i]; };
+
+    // vertices by increasing degree, to pick the start of every component
+    std::vector<uint> by_degree(n);
+    for (uint i = 0; i < n; i++)
+        by_degree[i] = i;
+    std::stable_sort(by_degree.begin(), by_degree.end(), [&](uint _a, uint _b) { return degree(_a) < degree(_b); });
+
+    std::vector<uint> order;
+    order.reserve(n);
+    std::vector<bool> visited(n, false);
+    std::vector<uint> marks(n, 0); // breadth-first search of the pseudo-peripheral vertex, marked with the start + 1
+    std::vector<uint> queue;
+    queue.reserve(n);
+    std::vector<uint> sorted_neighbors;
+
+    // breadth-first search from _start over the unvisited vertices, returns the last vertex reached
+    auto farthest = [&](uint _start) {
+        queue.clear();
+        queue.push_back(_start);
+        uint stamp = _start + 1;
+        marks[_start] = stamp;
+        for (uint head = 0; head < queue.size(); head++) {
+            uint v = queue[head];
+            for (uint k = offsets[v]; k < offsets[v + 1]; k++) {
+                uint w = neighbors[k];
+                if (!visited[w] && marks[w] != stamp) {
+                    marks[w] = stamp;
+                    queue.push_back(w);
+                }
+            }
+        }
+        return queue.back();
+    };
+
+    for (uint candidate : by_degree) {
+        if (visited[candidate])
+            continue;
+        uint start = farthest(candidate);
+
+        // Cuthill-McKee traversal of the component
+        uint head = order.size();
+        order.push_back(start);
+        visited[start] = true;
+        for (; head < order.size(); head++) {
+            uint v = order[head];
+            sorted_neighbors.clear();
+            for (uint k = offsets[v]; k < offsets[v + 1]; k++) {
+                uint w = neighbors[k];
+                if (!visited[w]) {
+                    visited[w] = true;
+                    sorted_neighbors.push_back(w);
+                }
+            }
+            std::sort(sorted_neighbors.begin(), sorted_neighbors.end(), [&](uint _a, uint _b) {
+                return degree(_a) < degree(_b) || (degree(_a) == degree(_b) && _a < _b);
+            });
+            order.insert(order.end(), sorted_neighbors.begin(), sorted_neighbors.end());
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+std::vector<uint> VertexOrdering::inverse(const std::vector<uint> &_order) {
+    std::vector<uint> inverse(_order.size());
+    for (uint i = 0; i < _order.size(); i++)
+        inverse[_order[i]] = i;
+    return inverse;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <vector>
+
+enum VertexOrder {
+    MORTON_ORDER,        // along a Z-order space-filling curve through the positions
+    CUTHILL_MCKEE_ORDER, // reverse Cuthill-McKee on the graph of the constraints (minimizes the bandwidth)
+};
+
+/*
+Vertex permutations which bring the vertices used together close in memory. They return _order with
+_order[new index] = old index, the convention of ConstraintBatch::permute.
+*/
+namespace VertexOrdering {
+// Morton code of the positions quantized on 2^10 cells per axis in their bounding box, ties keep the old order
+std::vector<uint> mortonOrder(const std::vector<glm::vec3> &_positions);
+
+/*
+READ "Reducing the bandwidth of sparse symmetric matrices" (Cuthill & McKee 1969).
+The graph of _vertex_count vertices is given by its edges (duplicates allowed), e.g. every pair of vertices of a constraint.
+Every connected component is traversed breadth-first from a pseudo-peripheral vertex (the last vertex reached by
+a breadth-first search from a vertex of minimum degree), visiting the neighbors by increasing degree.
+The whole order is reversed at the end.
+*/
+std::vector<uint> reverseCuthillMcKeeOrder(uint _vertex_count, const std::vector<glm::uvec2> &_edges);
+
+// _inverse[_order[i]] = i
+std::vector<uint> inverse(const std::vector<uint> &_order);
+} // namespace VertexOrdering
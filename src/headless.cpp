@@ -0,0 +1,170 @@
+// Headless runner: steps a scenario without any window or OpenGL context and reports the throughput as JSON.
+//     hai823i_nomrigide_headless <scenario> [--steps N] [--threads T] [--output stats.json] [--trace trace.json]
+// --steps and --threads override the scenario, the report goes to stdout without --output. --trace enables the
+// Profiler and writes its last events as Chrome trace JSON.
+
+// GLM
+#include <glm/glm.hpp>
+
+// USUAL INCLUDES
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "AllocationCounter.hpp"
+#include "PhysicsWorld.hpp"
+#include "Profiler.hpp"
+#include "Scenario.hpp"
+#include "ThreadPool.hpp"
+#include "VertexArrays.hpp"
+using namespace std;
+
+static const char *SIMD_LEVEL_NAMES[] = {"scalar", "sse", "avx2"};
+static const char *SOLVER_PHASE_NAMES[SOLVER_PHASE_COUNT] = {"prediction", "collisions", "projection", "update"};
+
+static string jsonString(const string &_string) {
+    string escaped = "\"";
+    for (char c : _string) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+static void usage(const char *_program) {
+    fprintf(stderr, "usage: %s <scenario> [--steps N] [--threads T] [--output stats.json] [--trace trace.json]\n", _program);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2)
+        usage(argv[0]);
+    string scenario_file = argv[1], output_file, trace_file;
+    long steps_override = -1, threads_override = -1;
+    for (int a = 2; a < argc; a++) {
+        if (a + 1 >= argc)
+            usage(argv[0]);
+        if (strcmp(argv[a], "--steps") == 0)
+            steps_override = atol(argv[++a]);
+        else if (strcmp(argv[a], "--threads") == 0)
+            threads_override = atol(argv[++a]);
+        else if (strcmp(argv[a], "--output") == 0)
+            output_file = argv[++a];
+        else if (strcmp(argv[a], "--trace") == 0)
+            trace_file = argv[++a];
+        else
+            usage(argv[0]);
+    }
+
+    PhysicsWorld world;
+    Scenario scenario;
+    try {
+        scenario.load(scenario_file, world);
+    } catch (const exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    if (steps_override >= 0)
+        scenario.steps = steps_override;
+    if (threads_override >= 0)
+        scenario.threads = threads_override;
+
+    Profiler::global().setThreadName("main");
+    Profiler::global().setEnabled(!trace_file.empty());
+    ThreadPool thread_pool(scenario.threads);
+    world.setThreadPool(&thread_pool);
+
+    uint vertices = 0, constraints = 0;
+    for (uint o = 0; o < world.objectCount(); o++) {
+        vertices += world.object(o).vertexCount();
+        constraints += world.object(o).constraintCount();
+        world.object(o).reserveWorkspace(); // not timed
+    }
+
+    // Every step is timed as a whole, the phases and the iterations are summed over the objects (CPU time, larger
+    // than the wall clock time when the islands run in parallel; a sleeping object reports none)
+    typedef std::chrono::steady_clock clock;
+    vector<float> step_times(scenario.steps);
+    double phase_times[SOLVER_PHASE_COUNT] = {};
+    double island_time = 0., contact_time = 0.;
+    double iterations = 0., contacts = 0.;
+    size_t heap_allocations = 0, steady_heap_allocations = 0; // during the steps, by the steady updates (0 expected)
+    clock::time_point start = clock::now();
+    for (uint step = 0; step < scenario.steps; step++) {
+        clock::time_point step_start = clock::now();
+        const size_t step_heap_allocations = heapAllocationCount();
+        const WorldStats &stats = world.update(scenario.time_step);
+        step_times[step] = std::chrono::duration<float>(clock::now() - step_start).count();
+        heap_allocations += heapAllocationCount() - step_heap_allocations;
+
+        island_time += stats.island_time;
+        contact_time += stats.contact_time;
+        contacts += stats.contacts;
+        for (uint o = 0; o < world.objectCount(); o++) {
+            const SolverStats &solver_stats = world.object(o).solverStats();
+            iterations += solver_stats.iterations;
+            contacts += solver_stats.contacts;
+            for (uint phase = 0; phase < SOLVER_PHASE_COUNT; phase++)
+                phase_times[phase] += solver_stats.phase_times[phase];
+            if (solver_stats.steady)
+                steady_heap_allocations += solver_stats.heap_allocations;
+        }
+    }
+    double wall_time = std::chrono::duration<double>(clock::now() - start).count();
+
+    uint sleeping_objects = 0;
+    for (uint o = 0; o < world.objectCount(); o++)
+        sleeping_objects += world.object(o).isSleeping();
+
+    vector<float> sorted_times = step_times;
+    sort(sorted_times.begin(), sorted_times.end());
+    auto percentile = [&](float _p) { return sorted_times.empty() ? 0.f : sorted_times[uint(_p * (sorted_times.size() - 1))]; };
+    double steps = std::max(scenario.steps, 1u);
+
+    struct rusage resources;
+    getrusage(RUSAGE_SELF, &resources); // ru_maxrss in KiB on Linux
+
+    FILE *output = output_file.empty() ? stdout : fopen(output_file.c_str(), "w");
+    if (!output) {
+        fprintf(stderr, "%s: cannot write the report\n", output_file.c_str());
+        return EXIT_FAILURE;
+    }
+    fprintf(output, "{\n");
+    fprintf(output, "  \"scenario\": %s,\n", jsonString(scenario.name).c_str());
+    fprintf(output, "  \"objects\": %u,\n", world.objectCount());
+    fprintf(output, "  \"vertices\": %u,\n", vertices);
+    fprintf(output, "  \"constraints\": %u,\n", constraints);
+    fprintf(output, "  \"threads\": %u,\n", thread_pool.threadCount());
+    fprintf(output, "  \"simd\": \"%s\",\n", SIMD_LEVEL_NAMES[VertexKernels::simdLevel()]);
+    fprintf(output, "  \"steps\": %u,\n", scenario.steps);
+    fprintf(output, "  \"time_step\": %g,\n", scenario.time_step);
+    fprintf(output, "  \"wall_time\": %.6f,\n", wall_time);
+    fprintf(output, "  \"steps_per_second\": %.3f,\n", wall_time > 0. ? scenario.steps / wall_time : 0.);
+    fprintf(output, "  \"step_time\": {\"mean\": %.9f, \"p50\": %.9f, \"p95\": %.9f, \"max\": %.9f},\n",
+            wall_time / steps, percentile(0.5f), percentile(0.95f), sorted_times.empty() ? 0.f : sorted_times.back());
+    fprintf(output, "  \"phase_time\": {\"islands\": %.9f, \"contacts\": %.9f", island_time / steps, contact_time / steps);
+    for (uint phase = 0; phase < SOLVER_PHASE_COUNT; phase++)
+        fprintf(output, ", \"%s\": %.9f", SOLVER_PHASE_NAMES[phase], phase_times[phase] / steps);
+    fprintf(output, "},\n");
+    fprintf(output, "  \"iterations_per_step_summed_over_objects\": %.3f,\n", iterations / steps);
+    fprintf(output, "  \"contacts_per_step\": %.3f,\n", contacts / steps);
+    fprintf(output, "  \"sleeping_objects\": %u,\n", sleeping_objects);
+#ifdef HEAP_ALLOCATIONS_COUNTED
+    fprintf(output, "  \"heap_allocations\": {\"steps\": %zu, \"steady_updates\": %zu},\n", heap_allocations, steady_heap_allocations);
+#endif
+    fprintf(output, "  \"peak_memory_kb\": %ld\n", resources.ru_maxrss);
+    fprintf(output, "}\n");
+    if (output != stdout)
+        fclose(output);
+    if (!trace_file.empty() && !Profiler::global().writeChromeTrace(trace_file)) {
+        fprintf(stderr, "%s: cannot write the trace\n", trace_file.c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -24,7 +24,9 @@
 #include "ShaderProgram.hpp"
 #include "Camera.hpp"
 #include "Mesh.hpp"
-#include "DynamicObject.hpp"
+#include "PhysicsWorld.hpp"
+#include "Profiler.hpp"
+#include "SimulationThread.hpp"
 using namespace std;
 
 // TODO: SINGLETON
@@ -41,10 +43,11 @@ void globalInit();
 
 int main(void) {
     globalInit();
+    Profiler::global().setThreadName("render");
 
     // ShaderProgram shader = ShaderProgram("ressources/shaders/vertex_shader.glsl", "ressources/shaders/fragment_shader.glsl");
-    ShaderProgram shader = ShaderProgram("ressources/shaders/vertex_simple.glsl", "ressources/shaders/fragment_simple.glsl");
-    shader.link();
+    ShaderProgram shader = ShaderProgram("ressources/shaders/vertex_simple.glsl", "ressources/shaders/fragment_simple.glsl", "build/shader_cache"); // linked, or loaded from the program binary
+    FrameUniformBuffer frame_uniforms;
 
     // TODO: SCENE
     // init meshes
@@ -60,7 +63,8 @@ int main(void) {
     // meshes[1].computeBoundingSphere(center, radius);
     Camera camera(glm::vec3(), 8., glm::vec2(-M_PI_4 * 0.5, 0.));
 
-    DynamicObject triangle;
+    PhysicsWorld world;
+    DynamicObject &triangle = world.addObject();
     triangle.addVertex(glm::vec3(0.), glm::vec3(0.), 1.f, true);
     triangle.addVertex(glm::vec3(-1., 1., -1.), glm::vec3(5., 0., 0.), 1.f, false);
     triangle.addVertex(glm::vec3(-1., 1., 1.), glm::vec3(0.), 1.f, false);
@@ -79,7 +83,11 @@ int main(void) {
     triangle.addDistanceConstraint(4, 3, 1.f);
     triangle.addDistanceConstraint(3, 1, 1.f);
     triangle.addDistanceConstraint(1, 4, 1.f);
-    triangle.initRendering();
+    world.initRendering();
+
+    // the world is stepped at 60 Hz on its own thread from now on
+    SimulationThread simulation(world, 1.f / 60.f);
+    simulation.start();
 
     // for (Mesh &mesh : meshes) {
     //     mesh.init();
@@ -94,13 +102,17 @@ int main(void) {
     size_t frame_count = 0;
     glfwSwapInterval(1); // VSync - avoid having 3000 fps
     do {
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("swap buffers"); // waits for the VSync
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
 
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         frame_count++;
+        Profiler::global().frame(); // collects the events of the previous frame
 
         // Imgui
         ImGui_ImplOpenGL3_NewFrame();
@@ -113,10 +125,11 @@ int main(void) {
         // rhino_transfo.updateRotation();
         // glm::vec4 cam_center = rhino_transfo.computeTransformationMatrix() * glm::vec4(center, 1.0);
         camera.update(window, deltaTime, glm::vec3(0.), cursor_vel, scroll);
-        if (next_frame) {
-            triangle.update(deltaTime);
-            triangle.updateRenderedPositions();
-            // next_frame = false;
+        Profiler::global().drawWindow();
+        simulation.setPaused(!next_frame);
+        {
+            PROFILE_SCOPE("upload");
+            simulation.updateRenderedPositions();
         }
 
         // RENDER
@@ -124,10 +137,8 @@ int main(void) {
         shader.use();                                       // Use program
 
         // Update uniforms
-        glm::mat4 projection = camera.getProjectionMatrix();
         glm::mat4 view = camera.getViewMatrix();
-        shader.set("projection", projection);
-        shader.set("view", view);
+        frame_uniforms.update({camera.getProjectionMatrix(), view}); // shared by every program
 
         // Render Meshes
         // for (int i = 0; i < meshes.size(); i++) {
@@ -138,22 +149,30 @@ int main(void) {
         //     shader.set("normal_mat", normal_mat);
         //     meshes[i].render();
         // }
-        triangle.render();
+        {
+            PROFILE_SCOPE("render submission");
+            world.render();
+        }
 
         // ImGui Render
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            PROFILE_SCOPE("imgui");
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
 
         // Reset some controls
         scroll = glm::vec2(0.);
         cursor_vel = glm::vec2(0.);
     } while (glfwWindowShouldClose(window) == GLFW_FALSE);
 
+    simulation.stop();
+    frame_uniforms.clear();
     shader.~ShaderProgram();
     // for (Mesh &mesh : meshes) {
     //     mesh.clear();
     // }
-    triangle.clear();
+    world.clear();
 
     glfwTerminate();
 